@@ -0,0 +1,395 @@
+#ifndef SEARCH_ENGINE_PROJECT_BLOCKMAXWAND_H_
+#define SEARCH_ENGINE_PROJECT_BLOCKMAXWAND_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "Bm25.h"
+#include "IndexFile.h"
+#include "PostingList.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief Skip data and BM25 upper bounds for every posting list of a PostingIndex, which let a query jump over the parts of a list that cannot reach its top-k results.
+ * @details The upper bounds are stored without the inverse document frequency of the term, as the largest tf / (tf + norm) of each term and of each block of kBlockSize postings, so they only depend on the postings and the FieldLengths the index was built with, and BoundScale keeps them valid once documents are added to the FieldLengths afterwards. Only lists longer than one block get blocks, so the many rare terms of a corpus cost one bound and one offset each.
+ * @tparam T The unsigned integer type used for the document IDs.
+ */
+template <typename T>
+class BlockMaxIndex {
+   public:
+    static constexpr size_t kBlockSize = 128;
+
+    struct Block {
+        T last_document_id;
+        uint32_t byte_offset;  // from the start of the posting list to the first pair of the block
+        float max_factor;      // the largest tf / (tf + norm) of the block, rounded up
+    };
+
+    /*!
+     * @brief Computes the bounds and blocks of every posting list in the given index.
+     * @param field The lengths of the field the postings were built from, which must have been finalized.
+     */
+    void Build(const PostingIndex<T>& postings, const FieldLengths& field) {
+        this->Clear();
+        this->average_length_ = field.average_length;
+        this->max_factors_.reserve(postings.size());
+        this->block_offsets_.reserve(postings.size() + 1);
+        for (size_t term_id = 0; term_id < postings.size(); term_id++) {
+            this->block_offsets_.push_back(this->blocks_.size());
+            const PostingList<T> posting_list = postings[term_id];
+            if (posting_list.empty() == true) {
+                this->max_factors_.push_back(0);
+                continue;
+            }
+            const uint8_t* const data = posting_list.data();
+            const uint8_t* cursor = data;
+            const size_t document_frequency = PostingList<T>::ReadVarint(cursor);
+            const bool has_blocks = document_frequency > kBlockSize;
+            double term_max_factor = 0;
+            Block block = {.last_document_id = 0, .byte_offset = 0, .max_factor = 0};
+            double block_max_factor = 0;
+            T document_id = 0;
+            for (size_t i = 0; i < document_frequency; i++) {
+                if (i % kBlockSize == 0) {
+                    block.byte_offset = cursor - data;
+                    block_max_factor = 0;
+                }
+                document_id += PostingList<T>::ReadVarint(cursor);
+                const double term_frequency = PostingList<T>::ReadVarint(cursor);
+                const double factor = term_frequency / (term_frequency + field.norms[document_id]);
+                block_max_factor = std::max(block_max_factor, factor);
+                if (has_blocks == true && (i % kBlockSize == kBlockSize - 1 || i == document_frequency - 1)) {
+                    block.last_document_id = document_id;
+                    block.max_factor = RoundUp(block_max_factor);
+                    this->blocks_.push_back(block);
+                }
+                term_max_factor = std::max(term_max_factor, factor);
+            }
+            this->max_factors_.push_back(RoundUp(term_max_factor));
+        }
+        this->block_offsets_.push_back(this->blocks_.size());
+        this->blocks_.shrink_to_fit();
+    }
+
+    // The largest tf / (tf + norm) of the posting list of the given term ID, rounded up.
+    inline float MaxFactor(size_t term_id) const { return this->max_factors_[term_id]; }
+
+    /*!
+     * @brief Returns what the bounds of the index must be multiplied by to bound the scores computed with the given field, whose average length may have changed since the index was built.
+     * @details The norm of a document only shrinks, and its tf / (tf + norm) only grows, if the average length grows. norm' >= norm * built / current then holds for every document, so tf / (tf + norm') <= tf / (tf + norm) * current / built. The norms are rounded to floats, which the slack covers.
+     */
+    inline double BoundScale(const FieldLengths& field) const {
+        constexpr double kScaleSlack = 1 + 1e-6;
+        return this->average_length_ > 0 && field.average_length > this->average_length_ ? field.average_length / this->average_length_ * kScaleSlack : 1;
+    }
+
+    // The blocks of the posting list of the given term ID, which are empty if the list fits in a single block.
+    inline const Block* BlocksBegin(size_t term_id) const { return this->blocks_.data() + this->block_offsets_[term_id]; }
+    inline const Block* BlocksEnd(size_t term_id) const { return this->blocks_.data() + this->block_offsets_[term_id + 1]; }
+
+    // The amount of terms the index was built for.
+    inline size_t size() const { return this->max_factors_.size(); }
+
+    // The amount of heap memory held by the index.
+    inline size_t byte_count() const { return this->max_factors_.capacity() * sizeof(float) + this->block_offsets_.capacity() * sizeof(uint32_t) + this->blocks_.capacity() * sizeof(Block); }
+
+    inline void Clear() {
+        this->average_length_ = 0;
+        this->max_factors_ = MappableArray<float>();
+        this->block_offsets_ = MappableArray<uint32_t>();
+        this->blocks_ = MappableArray<Block>();
+    }
+
+    /*!
+     * @brief Writes the index to the given index file.
+     */
+    void Write(IndexFileWriter& writer) const {
+        uint64_t average_length_bits;
+        memcpy(&average_length_bits, &this->average_length_, sizeof(average_length_bits));
+        writer.WriteValue(average_length_bits);
+        writer.WriteArray(this->max_factors_);
+        writer.WriteArray(this->block_offsets_);
+        writer.WriteArray(this->blocks_);
+    }
+
+    /*!
+     * @brief Makes the index a read-only view of the index that Write wrote next in the given file, which must stay mapped for as long as the index is read.
+     * @return Whether the file held a well-formed index, whose blocks all lie within its array of blocks. If not, the index is left empty.
+     */
+    bool Map(IndexFileReader& reader) {
+        uint64_t average_length_bits;
+        if (reader.ReadValue(average_length_bits) == false || reader.ReadArray(this->max_factors_) == false || reader.ReadArray(this->block_offsets_) == false || reader.ReadArray(this->blocks_) == false ||
+            (this->block_offsets_.empty() == false && (this->block_offsets_.size() != this->max_factors_.size() + 1 || AreValidOffsets(this->block_offsets_, this->blocks_.size()) == false))) {
+            this->Clear();
+            return false;
+        }
+        memcpy(&this->average_length_, &average_length_bits, sizeof(this->average_length_));
+        return true;
+    }
+
+   private:
+    static inline float RoundUp(double value) {
+        const float rounded = (float)value;
+        return rounded < value ? std::nextafter(rounded, std::numeric_limits<float>::infinity()) : rounded;
+    }
+
+    double average_length_ = 0;             // the average length of the FieldLengths the index was built with
+    MappableArray<float> max_factors_;      // term ID -> largest tf / (tf + norm) of its posting list
+    MappableArray<uint32_t> block_offsets_;  // term ID -> subscript of its first block in blocks_, followed by the size of blocks_
+    MappableArray<Block> blocks_;
+};
+
+/*!
+ * @brief Walks one posting list in increasing document ID order, and can jump straight to the block that holds a given document ID.
+ */
+template <typename T>
+class PostingCursor {
+   public:
+    using Block = typename BlockMaxIndex<T>::Block;
+
+    // The document ID of a cursor that has walked past the end of its list.
+    static constexpr T kEnd = std::numeric_limits<T>::max();
+
+    /*!
+     * @param blocks_begin The blocks of the list, as returned by BlockMaxIndex::BlocksBegin. A list without blocks is treated as one block that ends at kEnd, whose bound is max_factor.
+     */
+    PostingCursor(const PostingList<T>& posting_list, const Block* blocks_begin, const Block* blocks_end, float max_factor) : data_(posting_list.data()), cursor_(posting_list.data()), end_(posting_list.data() + posting_list.byte_size()), blocks_begin_(blocks_begin), blocks_end_(blocks_end), block_(blocks_begin), max_factor_(max_factor) {
+        if (this->cursor_ != this->end_) {
+            PostingList<T>::ReadVarint(this->cursor_);
+        }
+        this->Next();
+    }
+
+    inline T document_id() const { return this->document_id_; }
+    inline uint32_t term_frequency() const { return this->term_frequency_; }
+
+    // Moves to the next posting of the list.
+    inline void Next() {
+        if (this->cursor_ == this->end_) {
+            this->document_id_ = kEnd;
+            return;
+        }
+        this->document_id_ += PostingList<T>::ReadVarint(this->cursor_);
+        this->term_frequency_ = PostingList<T>::ReadVarint(this->cursor_);
+    }
+
+    /*!
+     * @brief Moves to the first posting whose document ID is at least target, decoding only the block that may hold it.
+     */
+    void NextGeq(T target) {
+        if (this->document_id_ >= target) {
+            return;
+        }
+        if (this->blocks_begin_ == this->blocks_end_) {
+            do {
+                this->Next();
+            } while (this->document_id_ < target);
+            return;
+        }
+        this->ShallowAdvance(target);
+        if (this->block_ == this->blocks_end_) {
+            this->document_id_ = kEnd;
+            this->cursor_ = this->end_;
+            return;
+        }
+        if (this->block_ != this->blocks_begin_ && this->document_id_ < (this->block_ - 1)->last_document_id) {
+            // The gaps of a block are relative to the last document ID of the block before it.
+            this->cursor_ = this->data_ + this->block_->byte_offset;
+            this->document_id_ = (this->block_ - 1)->last_document_id;
+        }
+        do {
+            this->Next();
+        } while (this->document_id_ < target);
+    }
+
+    /*!
+     * @brief Moves the current block to the one that may hold target, without decoding any posting.
+     */
+    inline void ShallowAdvance(T target) {
+        while (this->block_ != this->blocks_end_ && this->block_->last_document_id < target) {
+            this->block_++;
+        }
+    }
+
+    // The last document ID covered by the current block, and its bound.
+    inline T block_last_document_id() const {
+        if (this->blocks_begin_ == this->blocks_end_) {
+            return kEnd;
+        }
+        return this->block_ != this->blocks_end_ ? this->block_->last_document_id : kEnd;
+    }
+    inline float block_max_factor() const {
+        if (this->blocks_begin_ == this->blocks_end_) {
+            return this->max_factor_;
+        }
+        return this->block_ != this->blocks_end_ ? this->block_->max_factor : 0;
+    }
+    inline float max_factor() const { return this->max_factor_; }
+
+   private:
+    const uint8_t* data_;
+    const uint8_t* cursor_;  // the first byte of the posting after the current one
+    const uint8_t* end_;
+    const Block* blocks_begin_;
+    const Block* blocks_end_;
+    const Block* block_;
+    float max_factor_;
+    T document_id_ = 0;
+    uint32_t term_frequency_ = 0;
+};
+
+/*!
+ * @brief One term of a query scored with BlockMaxWand.
+ */
+template <typename T>
+struct WandTerm {
+    PostingList<T> postings;
+    size_t document_frequency;  // the amount of documents that hold the term in the whole corpus, which postings may only be a part of
+    const FieldLengths* field;
+    const BlockMaxIndex<T>* block_max_index;
+    size_t ordinal;  // the subscript of postings in block_max_index
+};
+
+/*!
+ * @brief A document and the sum of the BM25 scores of every query term it holds.
+ */
+template <typename T>
+struct ScoredDocument {
+    T document_id;
+    double score;
+};
+
+/*!
+ * @brief Finds the result_count documents with the highest BM25 score for the given terms with Block-Max WAND, which skips every document, and every block of postings, whose upper bound cannot beat the lowest score kept so far.
+ * @details The results are exactly those of scoring every posting, with ties broken by the lowest document ID. The score of a document is summed in the order of the given terms, like ScoreBm25 callers do, so both compare equal.
+ * @param document_count The amount of documents in the corpus.
+ * @param is_deleted A predicate that takes a document ID and returns whether the document must be left out of the results.
+ * @return The best documents, in no particular order.
+ */
+template <typename T, typename IsDeleted>
+std::vector<ScoredDocument<T>> BlockMaxWand(const std::vector<WandTerm<T>>& terms, size_t document_count, size_t result_count, IsDeleted&& is_deleted) {
+    // A bound and a score of the same postings are computed in different orders, so bounds are inflated by far more than their rounding error before they are compared to a score.
+    constexpr double kBoundSlack = 1 + 1e-9;
+
+    std::vector<PostingCursor<T>> cursors;
+    std::vector<double> weights;
+    std::vector<double> bound_weights;  // the weights the bounds of each term are multiplied by
+    cursors.reserve(terms.size());
+    weights.reserve(terms.size());
+    bound_weights.reserve(terms.size());
+    for (auto&& term : terms) {
+        cursors.emplace_back(term.postings, term.block_max_index->BlocksBegin(term.ordinal), term.block_max_index->BlocksEnd(term.ordinal), term.block_max_index->MaxFactor(term.ordinal));
+        weights.push_back(Bm25Idf(term.document_frequency, document_count) * (kBm25K1 + 1));
+        bound_weights.push_back(weights.back() * term.block_max_index->BoundScale(*term.field));
+    }
+    // The subscripts of the cursors, sorted by their current document ID.
+    std::vector<size_t> order(cursors.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    auto by_document_id = [&cursors](size_t a, size_t b) { return cursors[a].document_id() < cursors[b].document_id(); };
+
+    // A heap of the best documents so far, whose front is the worst of them. Documents are visited in increasing document ID order, so a new document needs a strictly higher score than the worst one kept.
+    std::vector<ScoredDocument<T>> heap;
+    auto better = [](const ScoredDocument<T>& a, const ScoredDocument<T>& b) { return a.score != b.score ? a.score > b.score : a.document_id < b.document_id; };
+    if (result_count == 0) {
+        return heap;
+    }
+    heap.reserve(result_count);
+    double threshold = -std::numeric_limits<double>::infinity();
+
+    while (true) {
+        std::sort(order.begin(), order.end(), by_document_id);
+
+        // The pivot is the first cursor at which the term bounds, summed in document ID order, exceed the threshold. No document before its document ID can.
+        double upper_bound = 0;
+        size_t pivot = 0;
+        for (; pivot < order.size(); pivot++) {
+            const PostingCursor<T>& cursor = cursors[order[pivot]];
+            if (cursor.document_id() == PostingCursor<T>::kEnd) {
+                pivot = order.size();
+                break;
+            }
+            upper_bound += bound_weights[order[pivot]] * cursor.max_factor();
+            if (upper_bound * kBoundSlack > threshold) {
+                break;
+            }
+        }
+        if (pivot == order.size()) {
+            break;
+        }
+        const T pivot_document_id = cursors[order[pivot]].document_id();
+        while (pivot + 1 < order.size() && cursors[order[pivot + 1]].document_id() == pivot_document_id) {
+            pivot++;
+        }
+
+        // The block bounds are tighter than the term bounds, and are checked before any posting is decoded.
+        double block_upper_bound = 0;
+        for (size_t i = 0; i <= pivot; i++) {
+            PostingCursor<T>& cursor = cursors[order[i]];
+            cursor.ShallowAdvance(pivot_document_id);
+            block_upper_bound += bound_weights[order[i]] * cursor.block_max_factor();
+        }
+
+        if (block_upper_bound * kBoundSlack > threshold) {
+            if (cursors[order[0]].document_id() == pivot_document_id && is_deleted(pivot_document_id) == true) {
+                for (size_t i = 0; i <= pivot; i++) {
+                    cursors[order[i]].Next();
+                }
+            } else if (cursors[order[0]].document_id() == pivot_document_id) {
+                double score = 0;
+                for (size_t i = 0; i < cursors.size(); i++) {
+                    if (cursors[i].document_id() == pivot_document_id) {
+                        score += Bm25PostingScore(weights[i], cursors[i].term_frequency(), terms[i].field->norms[pivot_document_id]);
+                    }
+                }
+                if (heap.size() < result_count) {
+                    heap.push_back(ScoredDocument<T>{.document_id = pivot_document_id, .score = score});
+                    std::push_heap(heap.begin(), heap.end(), better);
+                } else if (score > heap.front().score) {
+                    std::pop_heap(heap.begin(), heap.end(), better);
+                    heap.back() = ScoredDocument<T>{.document_id = pivot_document_id, .score = score};
+                    std::push_heap(heap.begin(), heap.end(), better);
+                }
+                if (heap.size() == result_count) {
+                    threshold = heap.front().score;
+                }
+                for (size_t i = 0; i <= pivot; i++) {
+                    cursors[order[i]].Next();
+                }
+            } else {
+                // Some cursor before the pivot has not reached it yet, and is moved straight to it.
+                for (size_t i = 0; i < pivot && cursors[order[i]].document_id() < pivot_document_id; i++) {
+                    cursors[order[i]].NextGeq(pivot_document_id);
+                }
+            }
+        } else {
+            // No document up to the end of the shortest current block, or up to the next cursor after the pivot, can beat the threshold.
+            T next_document_id = pivot + 1 < order.size() ? cursors[order[pivot + 1]].document_id() : PostingCursor<T>::kEnd;
+            for (size_t i = 0; i <= pivot; i++) {
+                const T block_last_document_id = cursors[order[i]].block_last_document_id();
+                if (block_last_document_id != PostingCursor<T>::kEnd) {
+                    next_document_id = std::min<T>(next_document_id, block_last_document_id + 1);
+                }
+            }
+            next_document_id = std::max<T>(next_document_id, pivot_document_id + 1);
+            for (size_t i = 0; i <= pivot; i++) {
+                cursors[order[i]].NextGeq(next_document_id);
+            }
+        }
+    }
+    return heap;
+}
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_BLOCKMAXWAND_H_
\ No newline at end of file
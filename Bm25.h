@@ -0,0 +1,102 @@
+#ifndef SEARCH_ENGINE_PROJECT_BM25_H_
+#define SEARCH_ENGINE_PROJECT_BM25_H_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "IndexFile.h"
+#include "PostingList.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+// The term frequency saturation and the document length normalization of Okapi BM25, at their customary values.
+constexpr float kBm25K1 = 1.2f;
+constexpr float kBm25B = 0.75f;
+
+/*!
+ * @brief The length of one field, such as the text or the title, of every document, and the BM25 length norms derived from them.
+ * @details The lengths are recorded while the sources are parsed, and Finalize turns them into the per-document norms once every length is known, so scoring a posting never divides by the average length.
+ */
+struct FieldLengths {
+    std::vector<uint32_t> lengths;  // document ID -> amount of tokens in the field
+    std::vector<float> norms;       // document ID -> kBm25K1 * (1 - kBm25B + kBm25B * length / average_length), only filled by Finalize
+    double average_length = 0;
+
+    /*!
+     * @brief Computes average_length and norms from lengths.
+     */
+    void Finalize() {
+        uint64_t total_length = 0;
+        for (auto&& length : this->lengths) {
+            total_length += length;
+        }
+        this->average_length = this->lengths.empty() == true ? 0 : (double)total_length / this->lengths.size();
+        const double length_weight = this->average_length > 0 ? kBm25B / this->average_length : 0;
+        this->norms.resize(this->lengths.size());
+        for (size_t i = 0; i < this->lengths.size(); i++) {
+            this->norms[i] = kBm25K1 * (1 - kBm25B + length_weight * this->lengths[i]);
+        }
+        this->norms.shrink_to_fit();
+    }
+
+    inline void Clear() {
+        this->lengths = std::vector<uint32_t>();
+        this->norms = std::vector<float>();
+        this->average_length = 0;
+    }
+
+    /*!
+     * @brief Writes the lengths to the given index file. The norms are not written, since Read derives them again.
+     */
+    inline void Write(IndexFileWriter& writer) const { writer.WriteArray(this->lengths); }
+
+    /*!
+     * @brief Copies the lengths that Write wrote next in the given file, and finalizes them.
+     * @return Whether the file held the lengths of the given amount of documents. If not, the lengths are left empty.
+     */
+    bool Read(IndexFileReader& reader, size_t document_count) {
+        if (reader.ReadArray(this->lengths) == false || this->lengths.size() != document_count) {
+            this->Clear();
+            return false;
+        }
+        this->Finalize();
+        return true;
+    }
+
+    inline bool operator==(const FieldLengths& other) const { return this->lengths == other.lengths; }
+    inline bool operator!=(const FieldLengths& other) const { return this->lengths != other.lengths; }
+};
+
+/*!
+ * @brief The inverse document frequency of a term that appears in document_frequency of document_count documents, in the form that never goes negative.
+ */
+inline double Bm25Idf(size_t document_frequency, size_t document_count) { return std::log(1 + (document_count - document_frequency + 0.5) / (document_frequency + 0.5)); }
+
+/*!
+ * @brief The BM25 score of one posting, given the weight Bm25Idf * (kBm25K1 + 1) of its term and the norm of its document. Every BM25 score of the engine goes through this function, so that scores computed in different ways compare equal.
+ */
+inline double Bm25PostingScore(double weight, uint32_t term_frequency, float norm) { return weight * term_frequency / ((double)term_frequency + norm); }
+
+/*!
+ * @brief Scores every document of the given posting list against one query term, and hands each {document ID, score} pair to the given callback in increasing document ID order.
+ * @param document_frequency The amount of documents that hold the term in the whole corpus, which postings may only be a part of.
+ * @param field The lengths of the field the posting list was built from, which must have been finalized.
+ * @param document_count The amount of documents in the corpus.
+ */
+template <typename T, typename Callback>
+void ScoreBm25(const PostingList<T>& postings, size_t document_frequency, const FieldLengths& field, size_t document_count, Callback&& callback) {
+    const double weight = Bm25Idf(document_frequency, document_count) * (kBm25K1 + 1);
+    const float* const norms = field.norms.data();
+    for (auto&& posting : postings) {
+        callback(posting.first, Bm25PostingScore(weight, posting.second, norms[posting.first]));
+    }
+}
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_BM25_H_
\ No newline at end of file
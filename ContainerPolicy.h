@@ -0,0 +1,85 @@
+#ifndef SEARCH_ENGINE_PROJECT_CONTAINERPOLICY_H_
+#define SEARCH_ENGINE_PROJECT_CONTAINERPOLICY_H_
+
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "FlatHashMap.h"
+#include "SortedVectorMap.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+/*
+ * A container policy picks the containers of a RunTimeDatabase, and of the engines built on top of it, at compile time. Every policy provides:
+ *   HashMap<K, V>      the maps that are written to while sources are parsed, and the scratch maps of a query
+ *   HashSet<K>         the sets that are written to while sources are parsed
+ *   MetadataMap<K, V>  the meta-data indexes once parsing has finished
+ *   DocumentSet<K>     the document IDs of every meta-data value once parsing has finished
+ *   IngestPolicy       the policy of the partial databases that parsing threads fill before they are merged, whose meta-data containers must support inserts
+ */
+
+/*!
+ * @brief Node-based standard containers everywhere, which is how the RunTimeDatabase was originally laid out.
+ */
+struct StdContainerPolicy {
+    template <typename K, typename V>
+    using HashMap = std::unordered_map<K, V>;
+    template <typename K>
+    using HashSet = std::unordered_set<K>;
+    template <typename K, typename V>
+    using MetadataMap = std::unordered_map<K, V>;
+    template <typename K>
+    using DocumentSet = std::unordered_set<K>;
+    using IngestPolicy = StdContainerPolicy;
+};
+
+/*!
+ * @brief Flat open-addressing hash maps everywhere, which are the fastest to write to.
+ */
+struct FlatContainerPolicy {
+    template <typename K, typename V>
+    using HashMap = FlatHashMap<K, V>;
+    template <typename K>
+    using HashSet = FlatHashSet<K>;
+    template <typename K, typename V>
+    using MetadataMap = FlatHashMap<K, V>;
+    template <typename K>
+    using DocumentSet = FlatHashSet<K>;
+    using IngestPolicy = FlatContainerPolicy;
+};
+
+/*!
+ * @brief Flat hash maps while parsing, and sorted vectors for the meta-data indexes once parsing has finished, which is the smallest layout to serve queries from.
+ */
+struct CompactContainerPolicy {
+    template <typename K, typename V>
+    using HashMap = FlatHashMap<K, V>;
+    template <typename K>
+    using HashSet = FlatHashSet<K>;
+    template <typename K, typename V>
+    using MetadataMap = SortedVectorMap<K, V>;
+    template <typename K>
+    using DocumentSet = SortedVectorSet<K>;
+    using IngestPolicy = FlatContainerPolicy;
+};
+
+/*!
+ * @brief Moves the given index into an index of type To, which is free when both types are the same, and otherwise builds To from the given index.
+ */
+template <typename To, typename From>
+To ConvertIndex(From&& from) {
+    if constexpr (std::is_same_v<To, std::decay_t<From>>) {
+        return std::move(from);
+    } else {
+        return To(from);
+    }
+}
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_CONTAINERPOLICY_H_
\ No newline at end of file
@@ -0,0 +1,125 @@
+#ifndef SEARCH_ENGINE_PROJECT_DOCUMENTTABLE_H_
+#define SEARCH_ENGINE_PROJECT_DOCUMENTTABLE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "IndexFile.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief The size and the modification time a source file had when it was parsed, which tell whether the file has changed since.
+ */
+struct SourceVersion {
+    uint64_t byte_count;
+    int64_t modification_time;  // in the ticks of std::filesystem::file_time_type since its epoch
+
+    inline bool operator==(const SourceVersion& other) const { return this->byte_count == other.byte_count && this->modification_time == other.modification_time; }
+    inline bool operator!=(const SourceVersion& other) const { return !(*this == other); }
+};
+
+/*!
+ * @brief Maps dense document IDs, starting at 0, to the file paths of the sources they were parsed from, the versions of the files that were parsed, and whether the documents have been deleted since.
+ * @details Every path is stored once in a single string arena, so the table costs one offset and one version per document on top of the path bytes themselves, and one bit per document marks the deleted ones. A document ID is never handed out twice, so a deleted document keeps its path and version.
+ */
+class DocumentTable {
+   public:
+    /*!
+     * @brief Appends the given path to the table and returns its document ID, which is the amount of documents that were in the table before.
+     */
+    inline uint32_t Add(std::string_view path, SourceVersion version = {}) {
+        this->path_arena_.insert(this->path_arena_.end(), path.begin(), path.end());
+        this->path_offsets_.push_back(this->path_arena_.size());
+        this->versions_.push_back(version);
+        this->deleted_bits_.resize((this->size() + 63) / 64, 0);
+        return this->path_offsets_.size() - 2;
+    }
+
+    inline std::string_view Path(uint32_t document_id) const { return std::string_view(this->path_arena_.data() + this->path_offsets_[document_id], this->path_offsets_[document_id + 1] - this->path_offsets_[document_id]); }
+    inline SourceVersion Version(uint32_t document_id) const { return this->versions_[document_id]; }
+
+    /*!
+     * @brief Marks the given document as deleted, which keeps it out of every query result from now on.
+     */
+    inline void Delete(uint32_t document_id) {
+        uint64_t& word = this->deleted_bits_[document_id / 64];
+        const uint64_t bit = uint64_t(1) << (document_id % 64);
+        this->deleted_count_ += (word & bit) == 0 ? 1 : 0;
+        word |= bit;
+    }
+
+    inline bool IsDeleted(uint32_t document_id) const { return (this->deleted_bits_[document_id / 64] >> (document_id % 64) & 1) != 0; }
+
+    // The amount of documents in the table, including the deleted ones.
+    inline size_t size() const { return this->path_offsets_.size() - 1; }
+    inline size_t deleted_count() const { return this->deleted_count_; }
+
+    // The amount of deleted documents whose IDs are in [first_document_id, end_document_id).
+    inline size_t DeletedCount(uint32_t first_document_id, uint32_t end_document_id) const {
+        size_t count = 0;
+        for (uint32_t document_id = first_document_id; document_id < end_document_id;) {
+            if (document_id % 64 == 0 && end_document_id - document_id >= 64) {
+                count += __builtin_popcountll(this->deleted_bits_[document_id / 64]);
+                document_id += 64;
+            } else {
+                count += this->IsDeleted(document_id) == true ? 1 : 0;
+                document_id++;
+            }
+        }
+        return count;
+    }
+
+    inline void Clear() {
+        this->path_arena_.clear();
+        this->path_offsets_.assign(1, 0);
+        this->versions_.clear();
+        this->deleted_bits_ = std::vector<uint64_t>();
+        this->deleted_count_ = 0;
+    }
+
+    inline bool operator==(const DocumentTable& other) const { return this->path_arena_ == other.path_arena_ && this->path_offsets_ == other.path_offsets_ && this->versions_ == other.versions_ && this->deleted_bits_ == other.deleted_bits_; }
+
+    /*!
+     * @brief Writes the table to the given index file.
+     */
+    void Write(IndexFileWriter& writer) const {
+        writer.WriteArray(this->path_arena_);
+        writer.WriteArray(this->path_offsets_);
+        writer.WriteArray(this->versions_);
+        writer.WriteArray(this->deleted_bits_);
+    }
+
+    /*!
+     * @brief Makes the table a view of the table that Write wrote next in the given file, which must stay mapped for as long as the table is read. Adding a path copies the table out of the file first, and the deleted documents are always copied.
+     * @return Whether the file held a well-formed table. If not, the table is left empty.
+     */
+    bool Map(IndexFileReader& reader) {
+        if (reader.ReadArray(this->path_arena_) == false || reader.ReadArray(this->path_offsets_) == false || reader.ReadArray(this->versions_) == false || reader.ReadArray(this->deleted_bits_) == false ||
+            AreValidOffsets(this->path_offsets_, this->path_arena_.size()) == false || this->versions_.size() != this->size() || this->deleted_bits_.size() != (this->size() + 63) / 64) {
+            this->Clear();
+            return false;
+        }
+        this->deleted_count_ = 0;
+        for (auto&& word : this->deleted_bits_) {
+            this->deleted_count_ += __builtin_popcountll(word);
+        }
+        return true;
+    }
+
+   private:
+    MappableArray<char> path_arena_;
+    MappableArray<size_t> path_offsets_ = {0};  // document ID -> offset of its path in path_arena_, followed by the end of path_arena_
+    MappableArray<SourceVersion> versions_;     // document ID -> version of its source
+    std::vector<uint64_t> deleted_bits_;        // bit i is set if document ID i is deleted
+    size_t deleted_count_ = 0;
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_DOCUMENTTABLE_H_
\ No newline at end of file
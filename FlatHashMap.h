@@ -0,0 +1,351 @@
+#ifndef SEARCH_ENGINE_PROJECT_FLATHASHMAP_H_
+#define SEARCH_ENGINE_PROJECT_FLATHASHMAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief An open-addressing hash table that keeps its elements in one flat array, and resolves collisions with Robin Hood linear probing.
+ * @details Every slot stores its element next to a one-byte probe distance (0 for an empty slot), so a lookup is a short linear scan over contiguous memory that stops as soon as it reaches a slot that is closer to its home than the key would be. Hashes are spread with a Fibonacci multiply so that identity hashes such as std::hash<uint32_t> still fill the table evenly. Erasing shifts the following elements back instead of leaving tombstones. This is the shared implementation of FlatHashMap and FlatHashSet.
+ * @tparam K The key type, which must be default constructible and copyable.
+ * @tparam Value The element type, which must be default constructible and move assignable.
+ * @tparam KeyOf A function object that returns the key of an element.
+ */
+template <typename K, typename Value, typename KeyOf, typename Hash, typename KeyEqual>
+class FlatHashTable {
+   public:
+    using key_type = K;
+    using value_type = Value;
+    using size_type = size_t;
+
+    template <bool kConst>
+    class IteratorBase {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Value;
+        using difference_type = std::ptrdiff_t;
+        using pointer = std::conditional_t<kConst, const Value*, Value*>;
+        using reference = std::conditional_t<kConst, const Value&, Value&>;
+        using Table = std::conditional_t<kConst, const FlatHashTable, FlatHashTable>;
+
+        IteratorBase() : table_(nullptr), index_(0) {}
+        IteratorBase(Table* table, size_t index) : table_(table), index_(index) {}
+        // Lets an iterator be converted to a const_iterator.
+        template <bool kOtherConst, typename = std::enable_if_t<kConst && !kOtherConst>>
+        IteratorBase(const IteratorBase<kOtherConst>& other) : table_(other.table_), index_(other.index_) {}
+
+        inline reference operator*() const { return this->table_->slots_[this->index_]; }
+        inline pointer operator->() const { return &this->table_->slots_[this->index_]; }
+
+        inline IteratorBase& operator++() {
+            this->index_ = this->table_->NextOccupied(this->index_ + 1);
+            return *this;
+        }
+
+        inline bool operator==(const IteratorBase& other) const { return this->index_ == other.index_; }
+        inline bool operator!=(const IteratorBase& other) const { return this->index_ != other.index_; }
+
+       private:
+        friend class FlatHashTable;
+        template <bool>
+        friend class IteratorBase;
+
+        Table* table_;
+        size_t index_;
+    };
+    using iterator = IteratorBase<false>;
+    using const_iterator = IteratorBase<true>;
+
+    FlatHashTable() = default;
+    FlatHashTable(const FlatHashTable&) = default;
+    FlatHashTable& operator=(const FlatHashTable&) = default;
+    // A moved-from table is left empty, like a moved-from std::unordered_map.
+    FlatHashTable(FlatHashTable&& other) noexcept { this->swap(other); }
+    FlatHashTable& operator=(FlatHashTable&& other) noexcept {
+        if (this != &other) {
+            FlatHashTable moved(std::move(other));
+            this->swap(moved);
+        }
+        return *this;
+    }
+
+    inline iterator begin() { return iterator(this, this->NextOccupied(0)); }
+    inline iterator end() { return iterator(this, this->capacity_); }
+    inline const_iterator begin() const { return const_iterator(this, this->NextOccupied(0)); }
+    inline const_iterator end() const { return const_iterator(this, this->capacity_); }
+
+    inline size_t size() const { return this->size_; }
+    inline bool empty() const { return this->size_ == 0; }
+    inline size_t bucket_count() const { return this->capacity_; }
+
+    // The amount of heap memory held by the table.
+    inline size_t byte_count() const { return this->slots_.capacity() * sizeof(Value) + this->distances_.capacity(); }
+
+    iterator find(const K& key) {
+        return iterator(this, this->FindIndex(key));
+    }
+
+    const_iterator find(const K& key) const {
+        return const_iterator(this, this->FindIndex(key));
+    }
+
+    inline size_t count(const K& key) const { return this->FindIndex(key) != this->capacity_ ? 1 : 0; }
+
+    /*!
+     * @brief Inserts the given element unless an element with the same key is already in the table.
+     * @return An iterator to the element with that key, and whether the element was inserted.
+     */
+    std::pair<iterator, bool> insert(Value&& value) {
+        const size_t index = this->FindIndex(KeyOf()(value));
+        if (index != this->capacity_) {
+            return {iterator(this, index), false};
+        }
+        return {iterator(this, this->InsertNew(std::move(value))), true};
+    }
+
+    std::pair<iterator, bool> insert(const Value& value) { return this->insert(Value(value)); }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args) {
+        return this->insert(Value(std::forward<Args>(args)...));
+    }
+
+    size_t erase(const K& key) {
+        size_t index = this->FindIndex(key);
+        if (index == this->capacity_) {
+            return 0;
+        }
+        // Shift the following elements of the probe sequence back by one, so lookups never have to skip over holes.
+        size_t next = (index + 1) & this->mask_;
+        while (this->distances_[next] > 1) {
+            this->slots_[index] = std::move(this->slots_[next]);
+            this->distances_[index] = this->distances_[next] - 1;
+            index = next;
+            next = (next + 1) & this->mask_;
+        }
+        this->slots_[index] = Value();
+        this->distances_[index] = 0;
+        this->size_--;
+        return 1;
+    }
+
+    /*!
+     * @brief Moves every element of other whose key is not in this table yet into this table, and then empties other.
+     * @warning Unlike std::unordered_map::merge, the elements whose keys were already in this table are dropped instead of being left in other.
+     */
+    void merge(FlatHashTable& other) {
+        this->reserve(this->size_ + other.size_);
+        for (auto&& value : other) {
+            if (this->FindIndex(KeyOf()(value)) == this->capacity_) {
+                this->InsertNew(std::move(value));
+            }
+        }
+        other.clear();
+    }
+
+    /*!
+     * @brief Grows the table so that it holds at least the given amount of elements without rehashing.
+     */
+    void reserve(size_t element_count) {
+        if (element_count * kMaxLoadDenominator > this->capacity_ * kMaxLoadNumerator) {
+            size_t capacity = std::max<size_t>(this->capacity_, kMinCapacity);
+            while (element_count * kMaxLoadDenominator > capacity * kMaxLoadNumerator) {
+                capacity <<= 1;
+            }
+            this->Rehash(capacity);
+        }
+    }
+
+    // Removes every element, but keeps the capacity of the table.
+    void clear() {
+        for (size_t i = 0; i < this->capacity_; i++) {
+            if (this->distances_[i] != 0) {
+                this->slots_[i] = Value();
+                this->distances_[i] = 0;
+            }
+        }
+        this->size_ = 0;
+    }
+
+    void swap(FlatHashTable& other) {
+        std::swap(this->slots_, other.slots_);
+        std::swap(this->distances_, other.distances_);
+        std::swap(this->capacity_, other.capacity_);
+        std::swap(this->mask_, other.mask_);
+        std::swap(this->shift_, other.shift_);
+        std::swap(this->size_, other.size_);
+    }
+
+    // Two tables are equal if they hold the same keys, and the elements with the same key are equal.
+    bool operator==(const FlatHashTable& other) const {
+        if (this->size_ != other.size_) {
+            return false;
+        }
+        for (auto&& value : *this) {
+            const size_t index = other.FindIndex(KeyOf()(value));
+            if (index == other.capacity_ || !(other.slots_[index] == value)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    inline bool operator!=(const FlatHashTable& other) const { return !(*this == other); }
+
+   protected:
+    // Returns the index of the element with the given key, or capacity_ if there is none.
+    size_t FindIndex(const K& key) const {
+        if (this->size_ == 0) {
+            return this->capacity_;
+        }
+        size_t index = this->HomeIndex(key);
+        for (uint8_t distance = 1; this->distances_[index] >= distance; distance++) {
+            if (KeyEqual()(KeyOf()(this->slots_[index]), key)) {
+                return index;
+            }
+            index = (index + 1) & this->mask_;
+        }
+        return this->capacity_;
+    }
+
+    // Inserts an element whose key is known not to be in the table yet, and returns its index.
+    size_t InsertNew(Value&& value) {
+        if ((this->size_ + 1) * kMaxLoadDenominator > this->capacity_ * kMaxLoadNumerator) {
+            this->Rehash(std::max<size_t>(this->capacity_ * 2, kMinCapacity));
+        }
+        const K key = KeyOf()(value);
+        size_t index = this->HomeIndex(key);
+        size_t inserted_index = this->capacity_;
+        uint8_t distance = 1;
+        while (this->distances_[index] != 0) {
+            // Robin Hood: an element that is closer to its home than the carried one gives up its slot and is carried on instead.
+            if (this->distances_[index] < distance) {
+                std::swap(distance, this->distances_[index]);
+                std::swap(value, this->slots_[index]);
+                if (inserted_index == this->capacity_) {
+                    inserted_index = index;
+                }
+            }
+            index = (index + 1) & this->mask_;
+            if (++distance == kMaxDistance) {
+                // The probe distance no longer fits in a byte, which only happens with a very poor hash. The carried element is put back through a bigger table.
+                this->Rehash(this->capacity_ * 2);
+                this->InsertNew(std::move(value));
+                return this->FindIndex(key);
+            }
+        }
+        this->distances_[index] = distance;
+        this->slots_[index] = std::move(value);
+        this->size_++;
+        return inserted_index == this->capacity_ ? index : inserted_index;
+    }
+
+   private:
+    static constexpr size_t kMinCapacity = 8;
+    // The table grows once it is 7/8 full.
+    static constexpr size_t kMaxLoadNumerator = 7;
+    static constexpr size_t kMaxLoadDenominator = 8;
+    static constexpr uint8_t kMaxDistance = 255;
+
+    inline size_t HomeIndex(const K& key) const { return (Hash()(key) * 0x9E3779B97F4A7C15ull) >> this->shift_; }
+
+    inline size_t NextOccupied(size_t index) const {
+        while (index < this->capacity_ && this->distances_[index] == 0) {
+            index++;
+        }
+        return index;
+    }
+
+    void Rehash(size_t capacity) {
+        std::vector<Value> old_slots(capacity);
+        std::vector<uint8_t> old_distances(capacity, 0);
+        std::swap(old_slots, this->slots_);
+        std::swap(old_distances, this->distances_);
+        this->capacity_ = capacity;
+        this->mask_ = capacity - 1;
+        this->shift_ = 64;
+        for (size_t i = capacity; i > 1; i >>= 1) {
+            this->shift_--;
+        }
+        this->size_ = 0;
+        for (size_t i = 0; i < old_distances.size(); i++) {
+            if (old_distances[i] != 0) {
+                this->InsertNew(std::move(old_slots[i]));
+            }
+        }
+    }
+
+    std::vector<Value> slots_;
+    std::vector<uint8_t> distances_;  // 0 for an empty slot, and otherwise 1 + the distance of the slot from the home slot of its element
+    size_t capacity_ = 0;             // always 0 or a power of two
+    size_t mask_ = 0;
+    unsigned shift_ = 63;
+    size_t size_ = 0;
+};
+
+template <typename K, typename V>
+struct FlatHashMapKeyOf {
+    inline const K& operator()(const std::pair<K, V>& value) const { return value.first; }
+};
+
+template <typename K>
+struct FlatHashSetKeyOf {
+    inline const K& operator()(const K& value) const { return value; }
+};
+
+/*!
+ * @brief A flat, open-addressing replacement for std::unordered_map. See FlatHashTable.
+ * @warning Inserting an element invalidates every iterator and reference into the map, and the keys of the elements are not const, so they must not be modified through an iterator.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class FlatHashMap : public FlatHashTable<K, std::pair<K, V>, FlatHashMapKeyOf<K, V>, Hash, KeyEqual> {
+   public:
+    using mapped_type = V;
+
+    V& operator[](const K& key) {
+        auto iter = this->find(key);
+        if (iter == this->end()) {
+            iter = typename FlatHashMap::iterator(this, this->InsertNew(std::pair<K, V>(key, V())));
+        }
+        return iter->second;
+    }
+
+    V& at(const K& key) {
+        auto iter = this->find(key);
+        if (iter == this->end()) {
+            throw std::out_of_range("FlatHashMap::at");
+        }
+        return iter->second;
+    }
+
+    const V& at(const K& key) const {
+        auto iter = this->find(key);
+        if (iter == this->end()) {
+            throw std::out_of_range("FlatHashMap::at");
+        }
+        return iter->second;
+    }
+};
+
+/*!
+ * @brief A flat, open-addressing replacement for std::unordered_set. See FlatHashTable.
+ * @warning Inserting an element invalidates every iterator and reference into the set.
+ */
+template <typename K, typename Hash = std::hash<K>, typename KeyEqual = std::equal_to<K>>
+class FlatHashSet : public FlatHashTable<K, K, FlatHashSetKeyOf<K>, Hash, KeyEqual> {};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_FLATHASHMAP_H_
\ No newline at end of file
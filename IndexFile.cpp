@@ -0,0 +1,168 @@
+#include "IndexFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+search_engine::source_util::IndexFileWriter::IndexFileWriter(const std::string& path) : path_(path), temporary_path_(path + ".tmp"), byte_count_(0), failed_(false) {
+    this->fd_ = open(this->temporary_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (this->fd_ == -1) {
+        std::cerr << "Error creating index file at " << this->temporary_path_ << std::endl;
+        this->failed_ = true;
+        return;
+    }
+    // The header is written once more by Close, when the size of the file is known.
+    const IndexFileHeader header = {};
+    this->WriteBytes(&header, sizeof(header));
+}
+
+search_engine::source_util::IndexFileWriter::~IndexFileWriter() {
+    if (this->fd_ != -1) {
+        close(this->fd_);
+        unlink(this->temporary_path_.c_str());
+    }
+}
+
+void search_engine::source_util::IndexFileWriter::WriteValue(uint64_t value) { this->WriteBytes(&value, sizeof(value)); }
+
+void search_engine::source_util::IndexFileWriter::WriteBytes(const void* data, size_t byte_count) {
+    static constexpr uint8_t kPadding[8] = {};
+    auto write_all = [this](const uint8_t* bytes, size_t size) {
+        while (this->failed_ == false && size > 0) {
+            const ssize_t result = write(this->fd_, bytes, size);
+            if (result <= 0) {
+                std::cerr << "Error writing index file at " << this->temporary_path_ << std::endl;
+                this->failed_ = true;
+                return;
+            }
+            bytes += result;
+            size -= result;
+        }
+    };
+    const size_t padding_byte_count = (8 - byte_count % 8) % 8;
+    write_all((const uint8_t*)data, byte_count);
+    write_all(kPadding, padding_byte_count);
+    this->byte_count_ += byte_count + padding_byte_count;
+}
+
+bool search_engine::source_util::IndexFileWriter::Close() {
+    if (this->failed_ == false) {
+        IndexFileHeader header = {.magic = {}, .version = kIndexFileVersion, .byte_order_mark = kIndexFileByteOrderMark, .file_byte_count = this->byte_count_};
+        memcpy(header.magic, kIndexFileMagic, sizeof(header.magic));
+        if (pwrite(this->fd_, &header, sizeof(header), 0) != sizeof(header)) {
+            std::cerr << "Error writing index file at " << this->temporary_path_ << std::endl;
+            this->failed_ = true;
+        }
+    }
+    // The contents must reach the disk before the rename does, or a crash could leave a renamed but empty or partial file in place of the old one.
+    if (this->failed_ == false && fsync(this->fd_) != 0) {
+        std::cerr << "Error syncing index file at " << this->temporary_path_ << std::endl;
+        this->failed_ = true;
+    }
+    if (this->fd_ != -1 && close(this->fd_) != 0 && this->failed_ == false) {
+        std::cerr << "Error writing index file at " << this->temporary_path_ << std::endl;
+        this->failed_ = true;
+    }
+    this->fd_ = -1;
+    if (this->failed_ == false && rename(this->temporary_path_.c_str(), this->path_.c_str()) != 0) {
+        std::cerr << "Error moving index file to " << this->path_ << std::endl;
+        this->failed_ = true;
+    }
+    // The rename itself is only durable once the directory that holds the file is synced.
+    if (this->failed_ == false) {
+        const std::string directory_path = std::filesystem::path(this->path_).parent_path().string();
+        const int directory_fd = open(directory_path.empty() == true ? "." : directory_path.c_str(), O_RDONLY | O_DIRECTORY);
+        if (directory_fd == -1 || fsync(directory_fd) != 0) {
+            std::cerr << "Error syncing the directory of index file " << this->path_ << std::endl;
+            this->failed_ = true;
+        }
+        if (directory_fd != -1) {
+            close(directory_fd);
+        }
+    }
+    if (this->failed_ == true) {
+        unlink(this->temporary_path_.c_str());
+    }
+    return this->failed_ == false;
+}
+
+search_engine::source_util::MappedIndexFile::~MappedIndexFile() {
+    if (this->data_ != nullptr) {
+        munmap((void*)this->data_, this->byte_count_);
+    }
+}
+
+bool search_engine::source_util::MappedIndexFile::Open(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Error opening index file at " << path << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        std::cerr << "Error getting file size at " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    if ((size_t)st.st_size < sizeof(IndexFileHeader)) {
+        std::cerr << "Not an index file: " << path << std::endl;
+        close(fd);
+        return false;
+    }
+    void* const data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Error mapping index file at " << path << std::endl;
+        return false;
+    }
+    this->data_ = (const uint8_t*)data;
+    this->byte_count_ = st.st_size;
+
+    const IndexFileHeader* const header = (const IndexFileHeader*)this->data_;
+    const char* error = nullptr;
+    if (memcmp(header->magic, kIndexFileMagic, sizeof(header->magic)) != 0) {
+        error = "Not an index file: ";
+    } else if (header->byte_order_mark != kIndexFileByteOrderMark) {
+        error = "The index file was written on a machine of another byte order: ";
+    } else if (header->version != kIndexFileVersion) {
+        error = "The index file was written by another version of the engine: ";
+    } else if (header->file_byte_count != this->byte_count_) {
+        error = "The index file is incomplete: ";
+    }
+    if (error != nullptr) {
+        std::cerr << error << path << std::endl;
+        munmap(data, this->byte_count_);
+        this->data_ = nullptr;
+        this->byte_count_ = 0;
+        return false;
+    }
+    return true;
+}
+
+bool search_engine::source_util::IndexFileReader::ReadValue(uint64_t& value) {
+    if (this->end_ - this->cursor_ < (std::ptrdiff_t)sizeof(value)) {
+        return false;
+    }
+    memcpy(&value, this->cursor_, sizeof(value));
+    this->cursor_ += sizeof(value);
+    return true;
+}
+
+bool search_engine::source_util::IndexFileReader::ReadArrayBytes(size_t element_size, const uint8_t*& data, size_t& size) {
+    uint64_t element_count;
+    if (this->ReadValue(element_count) == false || element_count > (size_t)(this->end_ - this->cursor_) / element_size) {
+        return false;
+    }
+    const size_t byte_count = element_count * element_size;
+    data = this->cursor_;
+    size = element_count;
+    this->cursor_ += std::min<size_t>(byte_count + (8 - byte_count % 8) % 8, this->end_ - this->cursor_);
+    return true;
+}
\ No newline at end of file
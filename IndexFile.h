@@ -0,0 +1,257 @@
+#ifndef SEARCH_ENGINE_PROJECT_INDEXFILE_H_
+#define SEARCH_ENGINE_PROJECT_INDEXFILE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace search_engine {
+
+namespace source_util {
+
+// The first bytes of every index file.
+constexpr char kIndexFileMagic[8] = {'S', 'E', 'I', 'N', 'D', 'E', 'X', '\0'};
+// Bumped whenever the layout of an index file changes, so that a file is never read with a layout it was not written with.
+constexpr uint32_t kIndexFileVersion = 5;
+// Written in the byte order of the machine that wrote the file, so a reader can tell whether it shares that byte order.
+constexpr uint32_t kIndexFileByteOrderMark = 0x01020304;
+
+/*!
+ * @brief The fixed-size start of an index file.
+ */
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    uint64_t file_byte_count;  // the size of the whole file, which tells a truncated file apart from a complete one
+};
+
+/*!
+ * @brief An array of trivially copyable elements that either owns them, in the std::vector it is built in, or borrows them from a memory-mapped index file.
+ * @details A borrowed array is read straight out of the mapping, and is copied into a std::vector of its own the first time it is modified. Only the reads that the immutable indexes do once they are built are supported, along with the handful of modifiers they are built with.
+ */
+template <typename E>
+class MappableArray {
+   public:
+    static_assert(std::is_trivially_copyable_v<E>, "A MappableArray is written to and mapped from a file byte for byte.");
+
+    using const_iterator = const E*;
+
+    MappableArray() = default;
+    MappableArray(std::initializer_list<E> elements) : owned_(elements) {}
+
+    /*!
+     * @brief Makes the array a read-only view of the given elements, which must outlive it or the next modification of it.
+     */
+    inline void Borrow(const E* data, size_t size) {
+        this->owned_ = std::vector<E>();
+        this->borrowed_data_ = data;
+        this->borrowed_size_ = size;
+        this->borrowed_ = true;
+    }
+
+    inline bool borrowed() const { return this->borrowed_; }
+
+    inline const E* data() const { return this->borrowed_ == true ? this->borrowed_data_ : this->owned_.data(); }
+    inline size_t size() const { return this->borrowed_ == true ? this->borrowed_size_ : this->owned_.size(); }
+    inline bool empty() const { return this->size() == 0; }
+    inline const E& operator[](size_t i) const { return this->data()[i]; }
+    inline const E& back() const { return this->data()[this->size() - 1]; }
+    inline const_iterator begin() const { return this->data(); }
+    inline const_iterator end() const { return this->data() + this->size(); }
+
+    // The amount of elements held on the heap, which is 0 for a borrowed array.
+    inline size_t capacity() const { return this->owned_.capacity(); }
+
+    inline void push_back(const E& element) {
+        this->Own();
+        this->owned_.push_back(element);
+    }
+
+    template <typename Iterator>
+    inline void insert(const_iterator position, Iterator first, Iterator last) {
+        const size_t subscript = position - this->data();
+        this->Own();
+        this->owned_.insert(this->owned_.begin() + subscript, first, last);
+    }
+
+    inline void reserve(size_t size) {
+        this->Own();
+        this->owned_.reserve(size);
+    }
+
+    inline void assign(size_t size, const E& element) {
+        this->borrowed_ = false;
+        this->owned_.assign(size, element);
+    }
+
+    inline void clear() {
+        this->borrowed_ = false;
+        this->owned_.clear();
+    }
+
+    inline void shrink_to_fit() { this->owned_.shrink_to_fit(); }
+
+    inline bool operator==(const MappableArray& other) const { return this->size() == other.size() && std::equal(this->begin(), this->end(), other.begin()); }
+    inline bool operator!=(const MappableArray& other) const { return !(*this == other); }
+
+   private:
+    inline void Own() {
+        if (this->borrowed_ == true) {
+            this->owned_.assign(this->borrowed_data_, this->borrowed_data_ + this->borrowed_size_);
+            this->borrowed_ = false;
+        }
+    }
+
+    std::vector<E> owned_;
+    const E* borrowed_data_ = nullptr;
+    size_t borrowed_size_ = 0;
+    bool borrowed_ = false;
+};
+
+/*!
+ * @brief Checks, in one pass, that the given offsets start at 0, never decrease and end at element_count, so that every range between two neighbouring offsets lies within an array of element_count elements, and that is_valid_range holds for every such range that is not empty.
+ * @details An index file is mapped as it was written, so its offsets must be checked before any range they point at is read.
+ */
+template <typename Offset, typename RangeCheck>
+bool AreValidOffsets(const MappableArray<Offset>& offsets, size_t element_count, RangeCheck&& is_valid_range) {
+    if (offsets.empty() == true || offsets[0] != 0 || offsets.back() != element_count) {
+        return false;
+    }
+    for (size_t i = 1; i < offsets.size(); i++) {
+        if (offsets[i] < offsets[i - 1] || (offsets[i] > offsets[i - 1] && is_valid_range(offsets[i - 1], offsets[i]) == false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Offset>
+inline bool AreValidOffsets(const MappableArray<Offset>& offsets, size_t element_count) {
+    return AreValidOffsets(offsets, element_count, [](size_t, size_t) { return true; });
+}
+
+/*!
+ * @brief Writes an index file as a header followed by a sequence of 64-bit values and arrays, each of which starts at a multiple of 8 bytes so that it can be read in place once the file is mapped.
+ * @details The file is written next to its destination and only renamed into place by Close, so a process that maps the destination never sees a partially written file.
+ */
+class IndexFileWriter {
+   public:
+    explicit IndexFileWriter(const std::string& path);
+    IndexFileWriter(const IndexFileWriter&) = delete;
+    IndexFileWriter& operator=(const IndexFileWriter&) = delete;
+    ~IndexFileWriter();
+
+    void WriteValue(uint64_t value);
+
+    /*!
+     * @brief Writes the amount of elements, followed by the elements themselves.
+     */
+    template <typename E>
+    void WriteArray(const E* data, size_t size) {
+        static_assert(std::is_trivially_copyable_v<E>, "Arrays are written byte for byte.");
+        this->WriteValue(size);
+        this->WriteBytes(data, size * sizeof(E));
+    }
+
+    template <typename E>
+    inline void WriteArray(const MappableArray<E>& array) { this->WriteArray(array.data(), array.size()); }
+    template <typename E>
+    inline void WriteArray(const std::vector<E>& vector) { this->WriteArray(vector.data(), vector.size()); }
+
+    /*!
+     * @brief Completes the header, syncs the file to disk, moves it to its destination, and syncs the directory that holds it, so that a crash leaves either the old file or the whole new one at the destination.
+     * @return Whether every write and sync succeeded. If not, an error has been printed, and the destination is left untouched unless only the sync of its directory failed.
+     */
+    bool Close();
+
+   private:
+    // Writes the given bytes, followed by enough zeros to reach a multiple of 8 bytes.
+    void WriteBytes(const void* data, size_t byte_count);
+
+    std::string path_;
+    std::string temporary_path_;
+    int fd_;
+    uint64_t byte_count_;
+    bool failed_;
+};
+
+/*!
+ * @brief An index file mapped read-only into the address space of the process.
+ * @details The mapping is shared, so every process that maps the same file reads it out of the same pages of the page cache, and only the pages a process actually reads are ever loaded.
+ */
+class MappedIndexFile {
+   public:
+    MappedIndexFile() : data_(nullptr), byte_count_(0) {}
+    MappedIndexFile(const MappedIndexFile&) = delete;
+    MappedIndexFile& operator=(const MappedIndexFile&) = delete;
+    ~MappedIndexFile();
+
+    /*!
+     * @brief Maps the index file at the given path.
+     * @return False, with an error printed, if the file cannot be mapped or is not a complete index file of kIndexFileVersion written with the byte order of this machine.
+     */
+    bool Open(const std::string& path);
+
+    inline const uint8_t* data() const { return this->data_; }
+    inline size_t byte_count() const { return this->byte_count_; }
+
+   private:
+    const uint8_t* data_;
+    size_t byte_count_;
+};
+
+/*!
+ * @brief Reads the values and arrays of a MappedIndexFile back in the order an IndexFileWriter wrote them.
+ * @details Every read is checked against the end of the file, and fails rather than reading past it.
+ */
+class IndexFileReader {
+   public:
+    explicit IndexFileReader(const MappedIndexFile& file) : cursor_(file.data() + sizeof(IndexFileHeader)), end_(file.data() + file.byte_count()) {}
+
+    bool ReadValue(uint64_t& value);
+
+    /*!
+     * @brief Makes the given array borrow the next array of the file, without copying it.
+     */
+    template <typename E>
+    bool ReadArray(MappableArray<E>& array) {
+        const E* data;
+        size_t size;
+        if (this->ReadArrayBytes(sizeof(E), (const uint8_t*&)data, size) == false) {
+            return false;
+        }
+        array.Borrow(data, size);
+        return true;
+    }
+
+    /*!
+     * @brief Copies the next array of the file into the given vector.
+     */
+    template <typename E>
+    bool ReadArray(std::vector<E>& vector) {
+        const E* data;
+        size_t size;
+        if (this->ReadArrayBytes(sizeof(E), (const uint8_t*&)data, size) == false) {
+            return false;
+        }
+        vector.assign(data, data + size);
+        return true;
+    }
+
+   private:
+    // Reads the size of the next array, whose elements are element_size bytes each, and points data at its first element.
+    bool ReadArrayBytes(size_t element_size, const uint8_t*& data, size_t& size);
+
+    const uint8_t* cursor_;
+    const uint8_t* end_;
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_INDEXFILE_H_
\ No newline at end of file
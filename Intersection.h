@@ -0,0 +1,251 @@
+#ifndef SEARCH_ENGINE_PROJECT_INTERSECTION_H_
+#define SEARCH_ENGINE_PROJECT_INTERSECTION_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "BlockMaxWand.h"
+#include "PositionIndex.h"
+#include "PostingList.h"
+#include "SortedVectorMap.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief Returns the first element of the sorted range [first, last) that is not less than target.
+ * @details The search probes 1, 2, 4, ... elements past first before it binary searches the last step, so it costs O(log d) comparisons, where d is the distance to the result, rather than O(log (last - first)). A caller that searches for increasing targets and passes the previous result as first therefore walks the range in O(m log (n / m)) for m targets.
+ */
+template <typename Iterator, typename T>
+Iterator GallopTo(Iterator first, Iterator last, const T& target) {
+    size_t step = 1;
+    Iterator low = first;
+    while (last - low > (std::ptrdiff_t)step && *(low + step) < target) {
+        low += step;
+        step *= 2;
+    }
+    return std::lower_bound(low, low + std::min<std::ptrdiff_t>(step + 1, last - low), target);
+}
+
+/*!
+ * @brief The documents that hold one term of a query: either a posting list of the values or the title, or the document set of a meta-data value.
+ * @tparam T The unsigned integer type used for the document IDs.
+ * @tparam DocumentSet The type of the document sets of the meta-data indexes.
+ */
+template <typename T, typename DocumentSet>
+struct TermDocuments {
+    PostingList<T> postings;                  // only read if documents is nullptr
+    const BlockMaxIndex<T>* block_max_index;  // the skip data of postings, or nullptr
+    size_t ordinal;                           // the subscript of postings in block_max_index
+    const DocumentSet* documents;             // the documents of a meta-data term, or nullptr
+
+    inline size_t size() const { return this->documents != nullptr ? this->documents->size() : this->postings.size(); }
+};
+
+/*!
+ * @brief Answers how often the documents of a TermDocuments hold its term, for document IDs that never decrease from one call to the next.
+ * @details A posting list is searched with a PostingCursor, which skips whole blocks of postings. A sorted document set is galloped through, and a hashed one is probed.
+ */
+template <typename T, typename DocumentSet>
+class MembershipCursor {
+   public:
+    explicit MembershipCursor(const TermDocuments<T, DocumentSet>& term) : documents_(term.documents), posting_cursor_(term.postings, term.block_max_index != nullptr ? term.block_max_index->BlocksBegin(term.ordinal) : nullptr, term.block_max_index != nullptr ? term.block_max_index->BlocksEnd(term.ordinal) : nullptr, 0) {
+        if (this->documents_ != nullptr) {
+            this->position_ = this->documents_->begin();
+        }
+    }
+
+    /*!
+     * @brief Returns the term frequency of the given document for a posting list, 1 for a document set that holds the document, and 0 if the document does not hold the term.
+     */
+    inline uint32_t Count(T document_id) {
+        if (this->documents_ == nullptr) {
+            this->posting_cursor_.NextGeq(document_id);
+            return this->posting_cursor_.document_id() == document_id ? this->posting_cursor_.term_frequency() : 0;
+        }
+        if constexpr (std::is_same_v<DocumentSet, SortedVectorSet<T>>) {
+            this->position_ = GallopTo(this->position_, this->documents_->end(), document_id);
+            return this->position_ != this->documents_->end() && *this->position_ == document_id ? 1 : 0;
+        } else {
+            return this->documents_->find(document_id) != this->documents_->end() ? 1 : 0;
+        }
+    }
+
+   private:
+    const DocumentSet* documents_;
+    PostingCursor<T> posting_cursor_;
+    typename DocumentSet::const_iterator position_;  // the first document of documents_ that may still be asked for, if documents_ is sorted
+};
+
+/*!
+ * @brief Hands every {document ID, count} pair of the given term to the given callback, where the count is the term frequency for a posting list and 1 for a document set.
+ * @param allowed The sorted document IDs to restrict the term to, or nullptr to visit every document of the term. With a restriction, the cost depends on the size of allowed rather than on the size of the term.
+ */
+template <typename T, typename DocumentSet, typename Callback>
+void ForEachMatch(const TermDocuments<T, DocumentSet>& term, const std::vector<T>* allowed, Callback&& callback) {
+    if (allowed == nullptr) {
+        if (term.documents != nullptr) {
+            for (auto&& document_id : *term.documents) {
+                callback(document_id, 1);
+            }
+        } else {
+            for (auto&& posting : term.postings) {
+                callback(posting.first, posting.second);
+            }
+        }
+        return;
+    }
+    MembershipCursor<T, DocumentSet> cursor(term);
+    for (auto&& document_id : *allowed) {
+        const uint32_t count = cursor.Count(document_id);
+        if (count > 0) {
+            callback(document_id, count);
+        }
+    }
+}
+
+/*!
+ * @brief Returns the sorted IDs of the documents that hold every required term and none of the excluded terms.
+ * @details The smallest required term is decoded into a list of candidates, and every other term, from the smallest to the largest, then removes the candidates it does not hold by searching for them in increasing document ID order. Each search skips ahead over the term, so the cost is bound by the size of the most selective term rather than by the sum of the sizes of every term, and shrinks as the query grows more selective.
+ * @param required The terms every document must hold, of which there must be at least one.
+ * @param excluded The terms no document may hold.
+ */
+template <typename T, typename DocumentSet>
+std::vector<T> IntersectDocuments(std::vector<const TermDocuments<T, DocumentSet>*> required, const std::vector<const TermDocuments<T, DocumentSet>*>& excluded) {
+    std::stable_sort(required.begin(), required.end(), [](const TermDocuments<T, DocumentSet>* a, const TermDocuments<T, DocumentSet>* b) { return a->size() < b->size(); });
+    std::vector<T> candidates;
+    const TermDocuments<T, DocumentSet>& smallest = *required.front();
+    if (smallest.size() == 0) {
+        return candidates;
+    }
+    candidates.reserve(smallest.size());
+    ForEachMatch(smallest, (const std::vector<T>*)nullptr, [&candidates](T document_id, uint32_t) { candidates.push_back(document_id); });
+    if (std::is_sorted(candidates.begin(), candidates.end()) == false) {
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+    auto retain = [&candidates](const TermDocuments<T, DocumentSet>& term, bool held) {
+        MembershipCursor<T, DocumentSet> cursor(term);
+        size_t kept_count = 0;
+        for (auto&& document_id : candidates) {
+            if ((cursor.Count(document_id) > 0) == held) {
+                candidates[kept_count++] = document_id;
+            }
+        }
+        candidates.resize(kept_count);
+    };
+    for (size_t i = 1; i < required.size() && candidates.empty() == false; i++) {
+        retain(*required[i], true);
+    }
+    for (size_t i = 0; i < excluded.size() && candidates.empty() == false; i++) {
+        if (excluded[i]->size() > 0) {
+            retain(*excluded[i], false);
+        }
+    }
+    return candidates;
+}
+
+/*!
+ * @brief One word of a phrase query.
+ */
+template <typename T>
+struct PhraseWord {
+    PostingList<T> postings;
+    const BlockMaxIndex<T>* block_max_index;  // the skip data of postings
+    size_t ordinal;                           // the subscript of postings in block_max_index
+    PositionList positions;                   // the positions of the word in the documents of postings, if the index has positions
+    uint32_t offset;                          // the place of the word in the phrase, which also counts the words before it that cannot be indexed, and that any word stands in for
+};
+
+/*!
+ * @brief Returns how many times the words whose sorted positions in one document are given appear in that document as a phrase.
+ * @details The words must appear in the given order, at least as far apart as their offsets in the phrase, and the span from the first to the last word may hold at most slop words more than the phrase does. A phrase is counted once per position it starts at. For each start, the earliest following position of every next word is picked, which gives the shortest span that starts there, and since these picks never move backwards as the start moves forwards, every list is walked once.
+ */
+inline uint32_t PhraseFrequency(const std::vector<std::vector<uint32_t>>& positions, const std::vector<uint32_t>& offsets, uint32_t slop, std::vector<size_t>& next_subscripts) {
+    next_subscripts.assign(positions.size(), 0);
+    uint32_t frequency = 0;
+    for (auto&& first_position : positions.front()) {
+        uint32_t previous_position = first_position;
+        for (size_t i = 1; i < positions.size(); i++) {
+            const uint32_t earliest_position = previous_position + (offsets[i] - offsets[i - 1]);
+            size_t& j = next_subscripts[i];
+            while (j < positions[i].size() && positions[i][j] < earliest_position) {
+                j++;
+            }
+            if (j == positions[i].size()) {
+                // A later start cannot complete the phrase either.
+                return frequency;
+            }
+            previous_position = positions[i][j];
+        }
+        if (previous_position - first_position - (offsets.back() - offsets.front()) <= slop) {
+            frequency++;
+        }
+    }
+    return frequency;
+}
+
+/*!
+ * @brief Hands every {document ID, phrase frequency} pair of the documents that hold the given words as a phrase to the given callback, in increasing document ID order.
+ * @details The documents that hold every word are found with IntersectDocuments first, so positions are only decoded for those documents, and PhraseFrequency then checks their positions. Without positions, every document that holds all of the words matches, and the lowest term frequency of its words stands in for its phrase frequency.
+ * @param slop The most words that may appear inside the phrase, which is 0 for an exact phrase.
+ * @param has_positions Whether the positions of the words were recorded while the sources were parsed.
+ */
+template <typename T, typename Callback>
+void MatchPhrase(const std::vector<PhraseWord<T>>& words, uint32_t slop, bool has_positions, Callback&& callback) {
+    // The document sets are never read, so any set type will do.
+    using WordDocuments = TermDocuments<T, SortedVectorSet<T>>;
+    std::vector<WordDocuments> word_documents;
+    word_documents.reserve(words.size());
+    for (auto&& word : words) {
+        word_documents.push_back(WordDocuments{.postings = word.postings, .block_max_index = word.block_max_index, .ordinal = word.ordinal, .documents = nullptr});
+    }
+    std::vector<const WordDocuments*> required;
+    for (auto&& word_document : word_documents) {
+        required.push_back(&word_document);
+    }
+    const std::vector<T> candidates = IntersectDocuments(required, std::vector<const WordDocuments*>());
+
+    if (has_positions == false) {
+        std::vector<MembershipCursor<T, SortedVectorSet<T>>> cursors(word_documents.begin(), word_documents.end());
+        for (auto&& document_id : candidates) {
+            uint32_t frequency = std::numeric_limits<uint32_t>::max();
+            for (auto&& cursor : cursors) {
+                frequency = std::min(frequency, cursor.Count(document_id));
+            }
+            callback(document_id, frequency);
+        }
+        return;
+    }
+
+    std::vector<PositionCursor<T>> cursors;
+    std::vector<uint32_t> offsets;
+    cursors.reserve(words.size());
+    offsets.reserve(words.size());
+    for (auto&& word : words) {
+        cursors.emplace_back(word.postings, word.positions);
+        offsets.push_back(word.offset);
+    }
+    std::vector<std::vector<uint32_t>> positions(words.size());
+    std::vector<size_t> next_subscripts;
+    for (auto&& document_id : candidates) {
+        for (size_t i = 0; i < cursors.size(); i++) {
+            cursors[i].NextGeq(document_id);
+            cursors[i].Positions(positions[i]);
+        }
+        const uint32_t frequency = PhraseFrequency(positions, offsets, slop, next_subscripts);
+        if (frequency > 0) {
+            callback(document_id, frequency);
+        }
+    }
+}
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_INTERSECTION_H_
\ No newline at end of file
@@ -1,45 +1,140 @@
 #include "KaggleFinanceSourceEngine.h"
 
 #include <fcntl.h>
+#include <malloc.h>
 #include <pthread.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
 
+#include "Tokenizer.h"
 #include "rapidjson/document.h"
 #include "rapidjson/istreamwrapper.h"
 
-search_engine::KaggleFinanceEngine::KaggleFinanceEngine(size_t parse_amount, size_t fill_amount) : parsing_thread_count_(parse_amount), filling_thread_count_(fill_amount) {
-    sem_init(&this->production_state_sem_, 1, 0);
-    pthread_mutex_init(&arbitrator_buffer_mutex_, NULL);
-    pthread_mutex_init(&metadata_mutex_, NULL);
-    this->alpha_buffer_ = std::move(std::vector<std::queue<AlphaBufferArgs>>(this->filling_thread_count_));
-    this->arbitrator_sem_vec_ = std::move(std::vector<sem_t>(this->filling_thread_count_));
+template <typename ContainerPolicy>
+search_engine::KaggleFinanceEngine<ContainerPolicy>::KaggleFinanceEngine(size_t parse_amount, size_t fill_amount, bool record_positions, std::optional<source_util::TieredMergePolicy> merge_policy)
+    : parsing_thread_count_(parse_amount), filling_thread_count_(fill_amount), record_positions_(record_positions), merge_policy_(merge_policy) {
+    this->alpha_buffer_ = std::move(std::vector<std::unique_ptr<source_util::MpscRingBuffer<AlphaBufferArgs>>>(this->filling_thread_count_));
     for (size_t i = 0; i < this->filling_thread_count_; i++) {
-        sem_init(this->arbitrator_sem_vec_.data() + i, 1, 0);
+        this->alpha_buffer_[i] = std::make_unique<source_util::MpscRingBuffer<AlphaBufferArgs>>(kAlphaBufferCapacity);
     }
-    this->alpha_buffer_mutex_ = std::move(std::vector<pthread_mutex_t>(this->filling_thread_count_));
-    for (size_t i = 0; i < this->filling_thread_count_; i++) {
-        pthread_mutex_init(this->alpha_buffer_mutex_.data() + i, NULL);
+}
+
+template <typename ContainerPolicy>
+search_engine::KaggleFinanceEngine<ContainerPolicy>::~KaggleFinanceEngine() {
+    // The merging thread reads database_, so it must be done before the database is destroyed.
+    if (this->segment_merge_ != nullptr) {
+        pthread_join(this->segment_merging_thread_, NULL);
     }
 }
 
-void search_engine::KaggleFinanceEngine::ParseSources(std::string file_path, const std::unordered_set<size_t>* const stop_words_ptr) {
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::ParseSources(std::string file_path, const std::unordered_set<std::string>* const stop_words_ptr) {
+    // A background merge reads the segments and the deleted documents, which are about to change.
+    this->FinishMerge();
+    // A source is known by its path, so the same folder must give the same paths however the caller spells it. The scan does not follow symbolic links to directories, so every path under the canonical folder is canonical too.
+    std::error_code canonical_ec;
+    const std::filesystem::path canonical_path = std::filesystem::weakly_canonical(file_path, canonical_ec);
+    if (!canonical_ec) {
+        file_path = canonical_path.string();
+    }
+    source_util::DocumentTable& document_table = this->database_.document_table;
+    // Every source that has been parsed before, and not deleted since, by path. The paths point into document_table, which is only appended to once the scan is over.
+    std::unordered_map<std::string_view, uint32_t> live_document_ids;
+    for (uint32_t document_id = 0; document_id < document_table.size(); document_id++) {
+        if (document_table.IsDeleted(document_id) == false) {
+            live_document_ids.emplace(document_table.Path(document_id), document_id);
+        }
+    }
+
+    this->source_change_stats_ = SourceChangeStats();
+    std::vector<source_util::SourceVersion> versions;  // of every file in files_
+    std::vector<uint32_t> deleted_document_ids;        // the sources deleted by this parse, because they changed or are gone
     auto it = std::filesystem::recursive_directory_iterator(file_path);
     for (auto&& entry : it) {
         if (entry.is_regular_file() == true && entry.path().extension().string() == ".json") {
+            std::error_code ec;
+            source_util::SourceVersion version = {.byte_count = entry.file_size(ec), .modification_time = 0};
+            if (ec) {
+                version.byte_count = 0;
+            }
+            version.modification_time = entry.last_write_time(ec).time_since_epoch().count();
+            auto live_document_iter = live_document_ids.find(entry.path().native());
+            if (live_document_iter != live_document_ids.end()) {
+                const uint32_t document_id = live_document_iter->second;
+                live_document_ids.erase(live_document_iter);
+                if (document_table.Version(document_id) == version) {
+                    this->source_change_stats_.unchanged_count++;
+                    continue;
+                }
+                document_table.Delete(document_id);
+                deleted_document_ids.push_back(document_id);
+                this->source_change_stats_.changed_count++;
+            } else {
+                this->source_change_stats_.new_count++;
+            }
             this->files_.push_back(std::move(entry.path()));
+            versions.push_back(version);
+        }
+    }
+    // What is left of live_document_ids are the sources that were not found, of which the ones that were parsed from under file_path are gone.
+    for (auto&& path_document_id_pair : live_document_ids) {
+        const std::string_view path = path_document_id_pair.first;
+        if (path.size() > file_path.size() && path.compare(0, file_path.size(), file_path) == 0 && (file_path.back() == '/' || path[file_path.size()] == '/')) {
+            document_table.Delete(path_document_id_pair.second);
+            deleted_document_ids.push_back(path_document_id_pair.second);
+            this->source_change_stats_.removed_count++;
         }
     }
+    // The segments that hold a deleted source recount how many of their postings are deleted, which the BM25 document frequencies leave out.
+    std::sort(deleted_document_ids.begin(), deleted_document_ids.end());
+    for (auto&& segment : this->database_.segments) {
+        auto deleted_document_iter = std::lower_bound(deleted_document_ids.begin(), deleted_document_ids.end(), segment.first_document_id);
+        if (deleted_document_iter != deleted_document_ids.end() && *deleted_document_iter < segment.end_document_id) {
+            segment.CountDeletedPostings(document_table);
+        }
+    }
+    if (this->files_.empty() == true) {
+        this->StartMerge();
+        return;
+    }
+
+    std::unordered_set<uint32_t> stop_term_ids;
+    if (stop_words_ptr != NULL) {
+        std::string cleaned_stop_word;
+        for (auto&& stop_word : *stop_words_ptr) {
+            const size_t hash = source_util::Tokenizer::HashTerm(stop_word.c_str(), stop_word.size(), &cleaned_stop_word);
+            if (hash != source_util::Tokenizer::kInvalidHash) {
+                stop_term_ids.emplace(this->database_.term_dictionary.Intern(cleaned_stop_word, hash));
+            }
+        }
+    }
+
+    // The sources get the document IDs that follow every document of the database, in the order of files_, and go into a segment of their own.
+    Segment& segment = this->database_.segments.emplace_back();
+    segment.first_document_id = document_table.size();
+    segment.end_document_id = segment.first_document_id + this->files_.size();
+    segment.document_count = this->files_.size();
+    for (size_t i = 0; i < this->files_.size(); i++) {
+        document_table.Add(this->files_[i].string(), versions[i]);
+    }
+    // Every parsing thread only writes the lengths of the documents it parses, so the lengths can be written in place.
+    this->database_.value_lengths.lengths.resize(segment.end_document_id, 0);
+    this->database_.title_lengths.lengths.resize(segment.end_document_id, 0);
 
-    this->unformatted_database_ = std::move(std::vector<std::pair<size_t, std::unordered_map<size_t, uint32_t>>>(files_.size()));
-    this->database_.value_index = std::move(std::vector<std::unordered_map<size_t, std::unordered_map<size_t, uint32_t>>>(this->filling_thread_count_));
-    this->currently_parsing_ = true;
+    // value_index gets one shard per filling thread, so that each filling thread owns the shard it writes to.
+    this->database_.value_sharding = source_util::TermSharding{.shard_count = this->filling_thread_count_};
+    this->database_.value_index = std::move(std::vector<std::vector<PostingMap>>(this->database_.value_sharding.shard_count));
     this->file_buffer_array_ = std::move(std::vector<std::pair<char*, size_t>>(this->parsing_thread_count_));
     for (size_t i = 0; i < this->parsing_thread_count_; i++) {
         this->file_buffer_array_[i] = std::move(std::pair<char*, size_t>(new char[100000], 100000));
@@ -48,10 +143,8 @@ void search_engine::KaggleFinanceEngine::ParseSources(std::string file_path, con
     ParsingThreadArgs parsing_arg_array[this->parsing_thread_count_];
     FillingThreadArgs filling_arg_array[this->filling_thread_count_];
     pthread_t parsing_thread_array[this->parsing_thread_count_];
-    pthread_t filling_arbitrator_thread;
     pthread_t filling_thread_array[this->filling_thread_count_];
 
-    pthread_create(&filling_arbitrator_thread, NULL, this->ArbitratorThreadFunc, (void*)(this));
     for (size_t i = 0; i < this->filling_thread_count_; i++) {
         filling_arg_array[i] = {
             .obj_ptr = this,
@@ -60,43 +153,85 @@ void search_engine::KaggleFinanceEngine::ParseSources(std::string file_path, con
         pthread_create(filling_thread_array + i, NULL, this->FillingThreadFunc, (void*)(filling_arg_array + i));
     }
 
-    size_t proportion = files_.size() / this->parsing_thread_count_;
-    size_t prev = 0;
-    for (size_t i = 0; i < this->parsing_thread_count_ - 1; i++) {
+    // Files are handed out in contiguous batches of roughly equal byte size from a shared cursor, so a thread that draws long articles simply claims fewer batches.
+    std::vector<ParsingBatch> batches;
+    uintmax_t total_byte_count = 0;
+    for (auto&& version : versions) {
+        total_byte_count += version.byte_count;
+    }
+    const uintmax_t batch_byte_target = std::max<uintmax_t>(total_byte_count / (this->parsing_thread_count_ * kBatchesPerParsingThread), 1);
+    for (size_t i = 0; i < files_.size();) {
+        ParsingBatch batch = {.start = i, .end = i, .byte_count = 0};
+        while (batch.end < files_.size() && (batch.byte_count < batch_byte_target || batch.end == batch.start)) {
+            batch.byte_count += versions[batch.end++].byte_count;
+        }
+        batches.push_back(batch);
+        i = batch.end;
+    }
+    std::atomic<size_t> batch_cursor(0);
+
+    this->parsing_thread_stats_ = std::move(std::vector<ParsingThreadStats>(this->parsing_thread_count_));
+    this->partial_segment_vec_ = std::move(std::vector<IngestSegment>(this->parsing_thread_count_));
+    this->partial_title_postings_vec_ = std::move(std::vector<std::vector<TitlePosting>>(this->parsing_thread_count_));
+    if (this->record_positions_ == true) {
+        this->partial_value_positions_vec_ = std::move(std::vector<source_util::PositionRuns<uint32_t>>(this->parsing_thread_count_));
+        this->partial_title_positions_vec_ = std::move(std::vector<source_util::PositionRuns<uint32_t>>(this->parsing_thread_count_));
+    }
+    for (size_t i = 0; i < this->parsing_thread_count_; i++) {
         parsing_arg_array[i] = {
             .obj_ptr = this,
-            .stop_words_ptr = stop_words_ptr,
-            .start = prev,
-            .end = prev + proportion,
+            .stop_term_ids_ptr = stop_words_ptr != NULL ? &stop_term_ids : NULL,
+            .batches_ptr = &batches,
+            .batch_cursor_ptr = &batch_cursor,
             .file_buffer_subscript = i,
         };
         pthread_create(parsing_thread_array + i, NULL, this->ParsingThreadFunc, (void*)(parsing_arg_array + i));
-        prev = prev + proportion;
-    }
-    parsing_arg_array[this->parsing_thread_count_ - 1] = {
-        .obj_ptr = this,
-        .stop_words_ptr = stop_words_ptr,
-        .start = prev,
-        .end = files_.size(),
-        .file_buffer_subscript = this->parsing_thread_count_ - 1,
-    };
-    pthread_create(parsing_thread_array + this->parsing_thread_count_ - 1, NULL, this->ParsingThreadFunc, (void*)(parsing_arg_array + this->parsing_thread_count_ - 1));
+    }
 
     for (size_t i = 0; i < this->parsing_thread_count_; i++) {
         pthread_join(parsing_thread_array[i], NULL);
     }
-    this->currently_parsing_ = false;
+
+    for (size_t i = 0; i < this->filling_thread_count_; i++) {
+        this->alpha_buffer_[i]->Push(AlphaBufferArgs{
+            .document_id = kEndOfStream,
+            .words = {},
+        });
+    }
+
+    // The filling threads only touch value_index, so the per-thread metadata and title indexes are merged into database_ while they drain, one thread per index.
+    MergingThreadArgs merging_arg_array[kMergedIndexCount];
+    pthread_t merging_thread_array[kMergedIndexCount];
+    for (size_t i = 0; i < kMergedIndexCount; i++) {
+        merging_arg_array[i] = {
+            .obj_ptr = this,
+            .index_subscript = i,
+        };
+        pthread_create(merging_thread_array + i, NULL, this->MergingThreadFunc, (void*)(merging_arg_array + i));
+    }
+
+    for (size_t i = 0; i < kMergedIndexCount; i++) {
+        pthread_join(merging_thread_array[i], NULL);
+    }
+    std::vector<IngestSegment>().swap(this->partial_segment_vec_);
+    std::vector<std::vector<TitlePosting>>().swap(this->partial_title_postings_vec_);
+
     for (size_t i = 0; i < this->filling_thread_count_; i++) {
         pthread_join(filling_thread_array[i], NULL);
     }
-    pthread_join(filling_arbitrator_thread, NULL);
 
     for (size_t i = 0; i < this->parsing_thread_count_; i++) {
         delete[] this->file_buffer_array_[i].first;
     }
+    std::vector<std::pair<char*, size_t>>().swap(this->file_buffer_array_);
+    std::vector<std::filesystem::__cxx11::path>().swap(this->files_);
+
+    this->Freeze();
+    this->StartMerge();
 }
 
-void search_engine::KaggleFinanceEngine::DisplaySource(std::string file_path, bool just_header) {
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::DisplaySource(std::string file_path, bool just_header) {
     std::ifstream ifs(file_path);
     rapidjson::IStreamWrapper isw(ifs);
     rapidjson::Document doc;
@@ -115,44 +250,218 @@ void search_engine::KaggleFinanceEngine::DisplaySource(std::string file_path, bo
     }
 }
 
-void search_engine::KaggleFinanceEngine::ClearRuntimeDatabase() {
-    this->database_.id_map.clear();
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::ClearRuntimeDatabase() {
+    this->FinishMerge();
+    this->database_.term_dictionary.Clear();
+    this->database_.document_table.Clear();
+    this->database_.value_lengths.Clear();
+    this->database_.title_lengths.Clear();
+    this->database_.segments.clear();
+    this->database_.value_sharding = source_util::TermSharding();
     this->database_.value_index.clear();
     this->database_.title_index.clear();
-    this->database_.site_index.clear();
-    this->database_.language_index.clear();
-    this->database_.location_index.clear();
-    this->database_.person_index.clear();
-    this->database_.organization_index.clear();
-    this->database_.author_index.clear();
-    this->database_.country_index.clear();
+    // Only unmapped once nothing in the database points into it anymore.
+    this->index_file_.reset();
 }
 
-size_t search_engine::KaggleFinanceEngine::CleanID(const char* const id_token, std::optional<size_t> size) {
-    return std::hash<std::string_view>{}(std::string_view(id_token));
+template <typename ContainerPolicy>
+bool search_engine::KaggleFinanceEngine<ContainerPolicy>::SaveIndex(const std::string& index_path) const {
+    const Database& database = this->database_;
+    source_util::IndexFileWriter writer(index_path);
+    database.term_dictionary.Write(writer);
+    database.document_table.Write(writer);
+    database.value_lengths.Write(writer);
+    database.title_lengths.Write(writer);
+    writer.WriteValue(database.segments.size());
+    for (auto&& segment : database.segments) {
+        WriteSegment(segment, writer);
+    }
+    return writer.Close();
 }
 
-size_t search_engine::KaggleFinanceEngine::CleanValue(const char* const value_token, std::optional<size_t> size) {
-    std::string cleaned_token;
-    if (size.has_value() == false) {
-        size = strlen(value_token);
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::WriteSegment(const Segment& segment, source_util::IndexFileWriter& writer) {
+    writer.WriteValue(segment.first_document_id);
+    writer.WriteValue(segment.end_document_id);
+    writer.WriteValue(segment.document_count);
+    writer.WriteArray(segment.term_ids);
+    segment.value_postings.Write(writer);
+    segment.title_postings.Write(writer);
+    segment.value_block_maxes.Write(writer);
+    segment.title_block_maxes.Write(writer);
+    segment.value_positions.Write(writer);
+    segment.title_positions.Write(writer);
+    writer.WriteArray(segment.value_deleted_counts);
+    writer.WriteArray(segment.title_deleted_counts);
+    for (auto&& metadata_index : kMetadataIndexes) {
+        WriteMetadataIndex(segment.*metadata_index, writer);
     }
-    cleaned_token.resize(size.value());
-    for (size_t i = 0, j = 0; i < size; i++, j++) {
-        if (value_token[i] < 0 || value_token[i] > 127) {
-            return std::string::npos;
+}
+
+template <typename ContainerPolicy>
+bool search_engine::KaggleFinanceEngine<ContainerPolicy>::LoadIndex(const std::string& index_path) {
+    const auto start_time = std::chrono::steady_clock::now();
+    this->ClearRuntimeDatabase();
+    std::unique_ptr<source_util::MappedIndexFile> index_file = std::make_unique<source_util::MappedIndexFile>();
+    if (index_file->Open(index_path) == false) {
+        return false;
+    }
+
+    Database& database = this->database_;
+    source_util::IndexFileReader reader(*index_file);
+    uint64_t segment_count = 0;
+    bool is_well_formed = database.term_dictionary.Map(reader) == true && database.document_table.Map(reader) == true && database.value_lengths.Read(reader, database.document_table.size()) == true &&
+                          database.title_lengths.Read(reader, database.document_table.size()) == true && reader.ReadValue(segment_count) == true && segment_count <= database.document_table.size();
+    if (is_well_formed == true) {
+        database.segments.resize(segment_count);
+    }
+    // The segments must cover every document ID, in order, with at least one document each.
+    size_t end_document_id = 0;
+    for (size_t i = 0; is_well_formed == true && i < database.segments.size(); i++) {
+        is_well_formed = MapSegment(reader, database.term_dictionary.size(), database.segments[i]) == true && database.segments[i].first_document_id == end_document_id && database.segments[i].end_document_id > end_document_id;
+        end_document_id = database.segments[i].end_document_id;
+    }
+    is_well_formed = is_well_formed == true && end_document_id == database.document_table.size();
+    if (is_well_formed == false) {
+        std::cerr << "The index file is malformed: " << index_path << std::endl;
+        this->ClearRuntimeDatabase();
+        return false;
+    }
+    this->index_file_ = std::move(index_file);
+
+    this->load_stats_ = LoadStats{
+        .seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count(),
+        .file_byte_count = this->index_file_->byte_count(),
+        .steady_rss_byte_count = ResidentByteCount(),
+    };
+    this->StartMerge();
+    return true;
+}
+
+template <typename ContainerPolicy>
+bool search_engine::KaggleFinanceEngine<ContainerPolicy>::MapSegment(source_util::IndexFileReader& reader, size_t term_count, Segment& segment) {
+    uint64_t first_document_id;
+    uint64_t end_document_id;
+    uint64_t document_count;
+    if (reader.ReadValue(first_document_id) == false || reader.ReadValue(end_document_id) == false || reader.ReadValue(document_count) == false || end_document_id > std::numeric_limits<uint32_t>::max() || first_document_id > end_document_id ||
+        document_count > end_document_id - first_document_id) {
+        return false;
+    }
+    segment.first_document_id = first_document_id;
+    segment.end_document_id = end_document_id;
+    segment.document_count = document_count;
+    bool is_well_formed = reader.ReadArray(segment.term_ids) == true && segment.value_postings.Map(reader) == true && segment.title_postings.Map(reader) == true && segment.value_block_maxes.Map(reader) == true &&
+                          segment.title_block_maxes.Map(reader) == true && segment.value_positions.Map(reader) == true && segment.title_positions.Map(reader) == true &&
+                          reader.ReadArray(segment.value_deleted_counts) == true && reader.ReadArray(segment.title_deleted_counts) == true;
+    for (auto&& metadata_index : kMetadataIndexes) {
+        is_well_formed = is_well_formed == true && ReadMetadataIndex(reader, segment.*metadata_index) == true;
+    }
+    // Every ordinal must have a posting list in both fields, a list of positions and a count of deleted documents in neither or both, no more deleted documents than its lists hold, and must stand for a term ID of the dictionary.
+    const size_t ordinal_count = segment.term_ids.size();
+    is_well_formed = is_well_formed == true && segment.value_postings.size() == ordinal_count && segment.title_postings.size() == ordinal_count && segment.value_block_maxes.size() == ordinal_count && segment.title_block_maxes.size() == ordinal_count &&
+                     (segment.value_positions.empty() == true || segment.value_positions.size() == ordinal_count) && (segment.title_positions.empty() == true || segment.title_positions.size() == ordinal_count) &&
+                     segment.value_deleted_counts.size() == segment.title_deleted_counts.size() && (segment.value_deleted_counts.empty() == true || segment.value_deleted_counts.size() == ordinal_count);
+    for (size_t i = 0; is_well_formed == true && i < ordinal_count; i++) {
+        is_well_formed = segment.term_ids[i] < term_count && (i == 0 || segment.term_ids[i - 1] < segment.term_ids[i]) &&
+                         (segment.value_deleted_counts.empty() == true || (segment.value_deleted_counts[i] <= segment.value_postings[i].size() && segment.title_deleted_counts[i] <= segment.title_postings[i].size()));
+    }
+    return is_well_formed;
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::WriteMetadataIndex(const typename Database::MetadataIndex& metadata_index, source_util::IndexFileWriter& writer) {
+    // Values and document IDs are sorted, so the same database is always written to the same bytes, whatever its containers.
+    std::vector<const typename Database::MetadataIndex::value_type*> elements;
+    elements.reserve(metadata_index.size());
+    for (auto&& element : metadata_index) {
+        elements.push_back(&element);
+    }
+    std::sort(elements.begin(), elements.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+    std::vector<char> value_bytes;
+    std::vector<uint64_t> value_offsets = {0};
+    std::vector<uint32_t> document_ids;
+    std::vector<uint64_t> document_offsets = {0};
+    for (auto&& element : elements) {
+        value_bytes.insert(value_bytes.end(), element->first.begin(), element->first.end());
+        value_offsets.push_back(value_bytes.size());
+        const size_t first_document = document_ids.size();
+        document_ids.insert(document_ids.end(), element->second.begin(), element->second.end());
+        std::sort(document_ids.begin() + first_document, document_ids.end());
+        document_offsets.push_back(document_ids.size());
+    }
+    writer.WriteArray(value_bytes);
+    writer.WriteArray(value_offsets);
+    writer.WriteArray(document_ids);
+    writer.WriteArray(document_offsets);
+}
+
+template <typename ContainerPolicy>
+bool search_engine::KaggleFinanceEngine<ContainerPolicy>::ReadMetadataIndex(source_util::IndexFileReader& reader, typename Database::MetadataIndex& metadata_index) {
+    source_util::MappableArray<char> value_bytes;
+    source_util::MappableArray<uint64_t> value_offsets;
+    source_util::MappableArray<uint32_t> document_ids;
+    source_util::MappableArray<uint64_t> document_offsets;
+    if (reader.ReadArray(value_bytes) == false || reader.ReadArray(value_offsets) == false || reader.ReadArray(document_ids) == false || reader.ReadArray(document_offsets) == false || value_offsets.empty() == true ||
+        value_offsets.size() != document_offsets.size() || value_offsets.back() != value_bytes.size() || document_offsets.back() != document_ids.size()) {
+        return false;
+    }
+    auto value = [&value_bytes, &value_offsets](size_t i) { return std::string(value_bytes.data() + value_offsets[i], value_offsets[i + 1] - value_offsets[i]); };
+    if constexpr (std::is_same_v<typename Database::MetadataIndex, source_util::SortedVectorMap<std::string, source_util::SortedVectorSet<uint32_t>>>) {
+        // Everything was written sorted, so a sorted index is built straight from views of the document IDs in the file.
+        std::vector<std::pair<std::string, source_util::MappableArray<uint32_t>>> elements(value_offsets.size() - 1);
+        for (size_t i = 0; i < elements.size(); i++) {
+            elements[i].first = value(i);
+            elements[i].second.Borrow(document_ids.data() + document_offsets[i], document_offsets[i + 1] - document_offsets[i]);
         }
-        if (value_token[i] == '\'') {
-            j--;
-            continue;
+        metadata_index = typename Database::MetadataIndex(elements);
+    } else {
+        // Otherwise, the index is rebuilt like the merging threads build it, in the containers that can be inserted into, and then converted.
+        typename IngestSegment::MetadataIndex ingest_index;
+        for (size_t i = 0; i + 1 < value_offsets.size(); i++) {
+            auto& documents = ingest_index[value(i)];
+            for (size_t j = document_offsets[i]; j < document_offsets[i + 1]; j++) {
+                documents.emplace(document_ids[j]);
+            }
         }
-        cleaned_token[j] = tolower(value_token[i]);
+        metadata_index = source_util::ConvertIndex<typename Database::MetadataIndex>(std::move(ingest_index));
     }
+    return true;
+}
 
-    return std::hash<std::string_view>{}(std::string_view(cleaned_token));
+template <typename ContainerPolicy>
+uint32_t search_engine::KaggleFinanceEngine<ContainerPolicy>::CleanValue(const char* const value_token, std::optional<size_t> size) {
+    if (size.has_value() == false) {
+        size = strlen(value_token);
+    }
+    std::string cleaned_token;
+    const size_t hash = source_util::Tokenizer::HashTerm(value_token, size.value(), &cleaned_token);
+    if (hash == source_util::Tokenizer::kInvalidHash) {
+        return source_util::TermDictionary::kNoTerm;
+    }
+    return this->database_.term_dictionary.Find(cleaned_token, hash);
 }
 
-std::string search_engine::KaggleFinanceEngine::CleanMetaData(const char* const metadata_token, std::optional<size_t> size) {
+template <typename ContainerPolicy>
+std::vector<uint32_t> search_engine::KaggleFinanceEngine<ContainerPolicy>::CleanPhrase(const char* const phrase, size_t size) {
+    // The tokenizer works in place, so it is handed a copy of the phrase.
+    std::string phrase_buffer(phrase, size);
+    source_util::Tokenizer tokenizer(phrase_buffer.data(), phrase_buffer.size());
+    source_util::Tokenizer::Token token;
+    std::vector<uint32_t> term_ids;
+    while (tokenizer.Next(token) == true) {
+        // The words that cannot be indexed keep their places between the words around them, like they do in the positions of the sources.
+        if (term_ids.empty() == false) {
+            term_ids.insert(term_ids.end(), token.skipped_count, source_util::TermDictionary::kAnyTerm);
+        }
+        term_ids.push_back(this->database_.term_dictionary.Find(std::string_view(token.data, token.size), token.hash));
+    }
+    return term_ids;
+}
+
+template <typename ContainerPolicy>
+std::string search_engine::KaggleFinanceEngine<ContainerPolicy>::CleanMetaData(const char* const metadata_token, std::optional<size_t> size) {
     std::string cleaned_token;
     if (size.has_value() == false) {
         size = strlen(metadata_token);
@@ -172,7 +481,8 @@ std::string search_engine::KaggleFinanceEngine::CleanMetaData(const char* const
     return cleaned_token;
 }
 
-void search_engine::KaggleFinanceEngine::ParseSingleArticle(const size_t file_subscript, const std::unordered_set<size_t>* stop_words_ptr, size_t file_buffer_subscript) {
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::ParseSingleArticle(const size_t file_subscript, const std::unordered_set<uint32_t>* stop_term_ids_ptr, size_t file_buffer_subscript) {
     int fd = open(this->files_[file_subscript].c_str(), O_RDONLY | O_NONBLOCK | O_NOATIME | O_CLOEXEC);
     if (fd == -1) {
         std::cerr << "Error opening file at " << this->files_[file_subscript].c_str() << std::endl;
@@ -209,117 +519,551 @@ void search_engine::KaggleFinanceEngine::ParseSingleArticle(const size_t file_su
         return;
     }
 
-    const char* const delimeters = " \t\v\n\r,.?!;:\"/()";
-    size_t uuid = this->unformatted_database_[file_subscript].first = std::move(this->CleanID(doc["uuid"].GetString()));
+    const uint32_t document_id = this->database_.segments.back().first_document_id + file_subscript;
 
-    pthread_mutex_lock(&this->metadata_mutex_);
-    this->database_.id_map[uuid] = this->files_[file_subscript].string();
-    this->database_.site_index[this->CleanMetaData(doc["thread"]["site"].GetString())].emplace(uuid);
-    this->database_.author_index[this->CleanMetaData(doc["author"].GetString())].emplace(uuid);
-    this->database_.country_index[this->CleanMetaData(doc["thread"]["country"].GetString())].emplace(uuid);
-    this->database_.language_index[this->CleanMetaData(doc["language"].GetString())].emplace(uuid);
+    // Metadata and title postings go into this parsing thread's own partial segment, which ParseSources merges into the new segment of database_ once every parsing thread has joined.
+    IngestSegment& partial_database = this->partial_segment_vec_[file_buffer_subscript];
+    partial_database.site_index[this->CleanMetaData(doc["thread"]["site"].GetString())].emplace(document_id);
+    partial_database.author_index[this->CleanMetaData(doc["author"].GetString())].emplace(document_id);
+    partial_database.country_index[this->CleanMetaData(doc["thread"]["country"].GetString())].emplace(document_id);
+    partial_database.language_index[this->CleanMetaData(doc["language"].GetString())].emplace(document_id);
 
     rapidjson::GenericArray<false, rapidjson::Value> people_array = std::move(doc["entities"]["persons"].GetArray());
     for (auto&& person : people_array) {
-        this->database_.person_index[this->CleanMetaData(person["name"].GetString())].emplace(uuid);
+        partial_database.person_index[this->CleanMetaData(person["name"].GetString())].emplace(document_id);
     }
 
     rapidjson::GenericArray<false, rapidjson::Value> location_array = std::move(doc["entities"]["locations"].GetArray());
     for (auto&& location : location_array) {
-        this->database_.location_index[this->CleanMetaData(location["name"].GetString())].emplace(uuid);
+        partial_database.location_index[this->CleanMetaData(location["name"].GetString())].emplace(document_id);
     }
 
     rapidjson::GenericArray<false, rapidjson::Value> organization_array = std::move(doc["entities"]["organizations"].GetArray());
     for (auto&& organization : organization_array) {
-        this->database_.organization_index[this->CleanMetaData(organization["name"].GetString())].emplace(uuid);
+        partial_database.organization_index[this->CleanMetaData(organization["name"].GetString())].emplace(document_id);
     }
 
-    char* title_token = strtok((char*)doc["thread"]["title"].GetString(), delimeters);
-    while (title_token != NULL) {
-        size_t title_token_length = strlen(title_token);
-
-        size_t cleaned_title_token = this->CleanValue(title_token, title_token_length);
-        if (cleaned_title_token == std::string::npos) {
-            title_token = strtok(NULL, delimeters);
-            continue;
+    const rapidjson::Value& title_value = doc["thread"]["title"];
+    source_util::Tokenizer title_tokenizer((char*)title_value.GetString(), title_value.GetStringLength());
+    source_util::Tokenizer::Token title_token;
+    // The tokens that were skipped for holding a non-ASCII byte do not count toward the BM25 length of a field, but still take up a position, so that a phrase never matches across them.
+    uint32_t title_length = 0;
+    uint32_t title_position = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> title_term_positions;  // {term ID, position} of every title token, only filled if positions are recorded
+    while (title_tokenizer.Next(title_token) == true) {
+        const uint32_t term_id = this->database_.term_dictionary.Intern(std::string_view(title_token.data, title_token.size), title_token.hash);
+        title_position += title_token.skipped_count;
+        if (this->record_positions_ == true) {
+            title_term_positions.emplace_back(term_id, title_position);
         }
-        this->database_.title_index[cleaned_title_token].emplace(uuid, 0).first->second++;
+        title_length++;
+        title_position++;
+        this->partial_title_postings_vec_[file_buffer_subscript].push_back(TitlePosting{
+            .term_id = term_id,
+            .document_id = document_id,
+        });
+    }
+    this->database_.title_lengths.lengths[document_id] = title_length;
+    if (this->record_positions_ == true) {
+        std::sort(title_term_positions.begin(), title_term_positions.end());
+        std::vector<uint32_t> positions(title_term_positions.size());
+        size_t run_start = 0;
+        for (size_t i = 0; i < title_term_positions.size(); i++) {
+            positions[i] = title_term_positions[i].second;
+            if (i + 1 == title_term_positions.size() || title_term_positions[i + 1].first != title_term_positions[i].first) {
+                this->partial_title_positions_vec_[file_buffer_subscript].Add(title_term_positions[i].first, document_id, positions.data() + run_start, i + 1 - run_start);
+                run_start = i + 1;
+            }
+        }
+    }
 
-        title_token = strtok(NULL, delimeters);
+    // Terms are counted by their text first, so the shared term dictionary is only consulted once per distinct term of the article.
+    std::unordered_map<source_util::TermKey, TermOccurrences, source_util::TermKeyHash> term_count_map;
+    const rapidjson::Value& text_value = doc["text"];
+    source_util::Tokenizer text_tokenizer((char*)text_value.GetString(), text_value.GetStringLength());
+    source_util::Tokenizer::Token token;
+    uint32_t value_length = 0;
+    uint32_t value_position = 0;
+    std::vector<uint32_t> token_slots;      // token -> slot of its term, only filled if positions are recorded
+    std::vector<uint32_t> token_positions;  // token -> its position, only filled if positions are recorded
+    while (text_tokenizer.Next(token) == true) {
+        TermOccurrences& occurrences = term_count_map.try_emplace(source_util::TermKey{.term = std::string_view(token.data, token.size), .hash = token.hash}, TermOccurrences{.count = 0, .slot = (uint32_t)term_count_map.size()}).first->second;
+        occurrences.count++;
+        value_position += token.skipped_count;
+        if (this->record_positions_ == true) {
+            token_slots.push_back(occurrences.slot);
+            token_positions.push_back(value_position);
+        }
+        value_length++;
+        value_position++;
     }
-    pthread_mutex_unlock(&this->metadata_mutex_);
+    this->database_.value_lengths.lengths[document_id] = value_length;
 
-    std::unordered_map<size_t, uint32_t>& word_map = this->unformatted_database_[file_subscript].second;
-    char* save_ptr;
-    char* token = strtok_r((char*)doc["text"].GetString(), delimeters, &save_ptr);
-    while (token != NULL) {
-        size_t token_length = strlen(token);
+    // The positions of every term are scattered into one array, grouped by slot, rather than collected in a vector per term.
+    std::vector<uint32_t> slot_starts;
+    std::vector<uint32_t> slot_positions;
+    if (this->record_positions_ == true) {
+        slot_starts.assign(term_count_map.size() + 1, 0);
+        for (auto&& term_count_pair : term_count_map) {
+            slot_starts[term_count_pair.second.slot + 1] = term_count_pair.second.count;
+        }
+        for (size_t slot = 0; slot < term_count_map.size(); slot++) {
+            slot_starts[slot + 1] += slot_starts[slot];
+        }
+        std::vector<uint32_t> slot_cursors(slot_starts.begin(), slot_starts.end() - 1);
+        slot_positions.resize(value_length);
+        for (size_t i = 0; i < value_length; i++) {
+            slot_positions[slot_cursors[token_slots[i]]++] = token_positions[i];
+        }
+    }
 
-        size_t cleaned_token = this->CleanValue(token, token_length);
-        if (cleaned_token == std::string::npos || (stop_words_ptr != NULL && stop_words_ptr->find(cleaned_token) != stop_words_ptr->end())) {
-            token = strtok_r(NULL, delimeters, &save_ptr);
+    // Hand each filling thread every word of this article that falls into its shard as one batch, so a shard queue is locked once per article rather than once per word. The batches are the only copy of the article's word counts, and the filling threads free them as soon as they are in value_index.
+    const source_util::TermSharding& value_sharding = this->database_.value_sharding;
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> shard_words(value_sharding.shard_count);
+    for (auto&& shard : shard_words) {
+        shard.reserve(term_count_map.size() / value_sharding.shard_count + 1);
+    }
+    for (auto&& term_count_pair : term_count_map) {
+        const uint32_t term_id = this->database_.term_dictionary.Intern(term_count_pair.first.term, term_count_pair.first.hash);
+        if (stop_term_ids_ptr != NULL && stop_term_ids_ptr->find(term_id) != stop_term_ids_ptr->end()) {
             continue;
         }
-        auto iter = word_map.emplace(cleaned_token, 0);
-        iter.first->second++;
-
-        token = strtok_r(NULL, delimeters, &save_ptr);
+        shard_words[value_sharding.Shard(term_id)].emplace_back(term_id, term_count_pair.second.count);
+        if (this->record_positions_ == true) {
+            this->partial_value_positions_vec_[file_buffer_subscript].Add(term_id, document_id, slot_positions.data() + slot_starts[term_count_pair.second.slot], term_count_pair.second.count);
+        }
+    }
+    for (size_t i = 0; i < value_sharding.shard_count; i++) {
+        if (shard_words[i].empty() == true) {
+            continue;
+        }
+        this->alpha_buffer_[i]->Push(AlphaBufferArgs{
+            .document_id = document_id,
+            .words = std::move(shard_words[i]),
+        });
     }
-
-    pthread_mutex_lock(&this->arbitrator_buffer_mutex_);
-    this->arbitrator_buffer_.push(file_subscript);
-    pthread_mutex_unlock(&this->arbitrator_buffer_mutex_);
-    sem_post(&this->production_state_sem_);
 }
 
-void* search_engine::KaggleFinanceEngine::ParsingThreadFunc(void* _arg) {
+template <typename ContainerPolicy>
+void* search_engine::KaggleFinanceEngine<ContainerPolicy>::ParsingThreadFunc(void* _arg) {
     ParsingThreadArgs* const thread_args = (ParsingThreadArgs*)_arg;
-    for (size_t i = thread_args->start; i < thread_args->end; i++) {
-        thread_args->obj_ptr->ParseSingleArticle(i, thread_args->stop_words_ptr, thread_args->file_buffer_subscript);
+    ParsingThreadStats& stats = thread_args->obj_ptr->parsing_thread_stats_[thread_args->file_buffer_subscript];
+    const auto start_time = std::chrono::steady_clock::now();
+    while (true) {
+        const size_t batch_subscript = thread_args->batch_cursor_ptr->fetch_add(1, std::memory_order_relaxed);
+        if (batch_subscript >= thread_args->batches_ptr->size()) {
+            break;
+        }
+        const ParsingBatch& batch = (*thread_args->batches_ptr)[batch_subscript];
+        for (size_t i = batch.start; i < batch.end; i++) {
+            thread_args->obj_ptr->ParseSingleArticle(i, thread_args->stop_term_ids_ptr, thread_args->file_buffer_subscript);
+        }
+        stats.batch_count++;
+        stats.file_count += batch.end - batch.start;
+        stats.byte_count += batch.byte_count;
     }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
 
     return NULL;
 }
 
-void* search_engine::KaggleFinanceEngine::ArbitratorThreadFunc(void* _arg) {
-    search_engine::KaggleFinanceEngine* const parse_engine = (search_engine::KaggleFinanceEngine*)_arg;
-    while (parse_engine->currently_parsing_ == true || parse_engine->arbitrator_buffer_.empty() == false) {
-        if (sem_trywait(&parse_engine->production_state_sem_) != 0) {
-            continue;
+template <typename ContainerPolicy>
+void* search_engine::KaggleFinanceEngine<ContainerPolicy>::FillingThreadFunc(void* _arg) {
+    FillingThreadArgs* const thread_args = (FillingThreadArgs*)_arg;
+    while (true) {
+        const AlphaBufferArgs batch_args = std::move(thread_args->obj_ptr->alpha_buffer_[thread_args->buffer_subscript]->Pop());
+
+        if (batch_args.document_id == kEndOfStream) {
+            break;
         }
-        pthread_mutex_lock(&parse_engine->arbitrator_buffer_mutex_);
-        const size_t i = parse_engine->arbitrator_buffer_.front();
-        parse_engine->arbitrator_buffer_.pop();
-        pthread_mutex_unlock(&parse_engine->arbitrator_buffer_mutex_);
 
-        for (auto&& inner_element : parse_engine->unformatted_database_[i].second) {
-            size_t word_buffer_index = inner_element.first % parse_engine->filling_thread_count_;
+        const uint32_t document_id = batch_args.document_id;
+        auto& value_shard = thread_args->obj_ptr->database_.value_index[thread_args->buffer_subscript];
+        for (auto&& word_count_pair : batch_args.words) {
+            const size_t slot = thread_args->obj_ptr->database_.value_sharding.Slot(word_count_pair.first);
+            if (slot >= value_shard.size()) {
+                value_shard.resize(slot + 1);
+            }
+            value_shard[slot].emplace(document_id, word_count_pair.second);
+        }
+    }
+    return NULL;
+}
 
-            pthread_mutex_lock(&parse_engine->alpha_buffer_mutex_[word_buffer_index]);
-            parse_engine->alpha_buffer_[word_buffer_index].push(std::move(AlphaBufferArgs{
-                .file_subscript = i,
-                .word = std::move(inner_element.first),
-                .count = inner_element.second,
-            }));
-            pthread_mutex_unlock(&parse_engine->alpha_buffer_mutex_[word_buffer_index]);
-            sem_post(&parse_engine->arbitrator_sem_vec_[word_buffer_index]);
+template <typename ContainerPolicy>
+void* search_engine::KaggleFinanceEngine<ContainerPolicy>::MergingThreadFunc(void* _arg) {
+    MergingThreadArgs* const thread_args = (MergingThreadArgs*)_arg;
+    Database& database = thread_args->obj_ptr->database_;
+    if (thread_args->index_subscript == 0) {
+        // Every term has been interned by the time the parsing threads join.
+        database.title_index.resize(database.term_dictionary.size());
+        for (auto&& partial_title_postings : thread_args->obj_ptr->partial_title_postings_vec_) {
+            for (auto&& title_posting : partial_title_postings) {
+                database.title_index[title_posting.term_id].emplace(title_posting.document_id, 0).first->second++;
+            }
+            partial_title_postings.clear();
+        }
+        return NULL;
+    }
+    // The partial indexes are merged in the ingest layout, and only converted to the serving layout of database_ once they are complete.
+    typename IngestSegment::MetadataIndex metadata_index;
+    for (auto&& partial_database : thread_args->obj_ptr->partial_segment_vec_) {
+        auto& partial_metadata_index = partial_database.*kIngestMetadataIndexes[thread_args->index_subscript - 1];
+        if (metadata_index.empty() == true) {
+            metadata_index = std::move(partial_metadata_index);
+            partial_metadata_index.clear();
+            continue;
+        }
+        for (auto&& metadata_document_id_set_pair : partial_metadata_index) {
+            auto& document_id_set = metadata_index[metadata_document_id_set_pair.first];
+            if (document_id_set.empty() == true) {
+                document_id_set = std::move(metadata_document_id_set_pair.second);
+            } else {
+                document_id_set.merge(metadata_document_id_set_pair.second);
+            }
         }
+        partial_metadata_index.clear();
     }
+    database.segments.back().*kMetadataIndexes[thread_args->index_subscript - 1] = source_util::ConvertIndex<typename Database::MetadataIndex>(std::move(metadata_index));
     return NULL;
 }
 
-void* search_engine::KaggleFinanceEngine::FillingThreadFunc(void* _arg) {
-    FillingThreadArgs* const thread_args = (FillingThreadArgs*)_arg;
-    while (thread_args->obj_ptr->currently_parsing_ == true || thread_args->obj_ptr->alpha_buffer_[thread_args->buffer_subscript].empty() == false) {
-        if (sem_trywait(&thread_args->obj_ptr->arbitrator_sem_vec_[thread_args->buffer_subscript]) != 0) {
+template <typename ContainerPolicy>
+void* search_engine::KaggleFinanceEngine<ContainerPolicy>::FreezingThreadFunc(void* _arg) {
+    FreezingThreadArgs* const thread_args = (FreezingThreadArgs*)_arg;
+    Database& database = thread_args->obj_ptr->database_;
+    const bool is_title_thread = thread_args->shard_subscript == thread_args->obj_ptr->filling_thread_count_;
+    std::vector<PostingMap>& hash_maps = is_title_thread == true ? database.title_index : database.value_index[thread_args->shard_subscript];
+    source_util::PostingIndex<uint32_t>& posting_index = thread_args->obj_ptr->frozen_shards_[thread_args->shard_subscript];
+    posting_index.Clear();
+    thread_args->hash_map_byte_count = hash_maps.capacity() * sizeof(PostingMap);
+    for (auto&& postings : hash_maps) {
+        thread_args->hash_map_byte_count += ApproximateByteCount(postings);
+        posting_index.Append(postings);
+        PostingMap().swap(postings);
+    }
+    std::vector<PostingMap>().swap(hash_maps);
+    posting_index.ShrinkToFit();
+    return NULL;
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::Freeze() {
+    const auto start_time = std::chrono::steady_clock::now();
+    Database& database = this->database_;
+    Segment& segment = database.segments.back();
+
+    // Every shard, and title_index, is encoded by its own thread. The lists are then stitched back together in term ID order into the new segment, which only copies bytes.
+    this->frozen_shards_ = std::move(std::vector<source_util::PostingIndex<uint32_t>>(this->filling_thread_count_ + 1));
+    FreezingThreadArgs freezing_arg_array[this->filling_thread_count_ + 1];
+    pthread_t freezing_thread_array[this->filling_thread_count_ + 1];
+    for (size_t i = 0; i <= this->filling_thread_count_; i++) {
+        freezing_arg_array[i] = {
+            .obj_ptr = this,
+            .shard_subscript = i,
+            .hash_map_byte_count = 0,
+        };
+        pthread_create(freezing_thread_array + i, NULL, this->FreezingThreadFunc, (void*)(freezing_arg_array + i));
+    }
+    this->posting_memory_stats_ = PostingMemoryStats();
+    for (size_t i = 0; i <= this->filling_thread_count_; i++) {
+        pthread_join(freezing_thread_array[i], NULL);
+        this->posting_memory_stats_.hash_map_byte_count += freezing_arg_array[i].hash_map_byte_count;
+    }
+    database.value_index.clear();
+
+    // Only the terms that the new sources hold get an ordinal in the new segment.
+    const source_util::PostingIndex<uint32_t>& frozen_titles = this->frozen_shards_[this->filling_thread_count_];
+    auto value_list = [this, &database](size_t term_id) {
+        const source_util::PostingIndex<uint32_t>& frozen_shard = this->frozen_shards_[database.value_sharding.Shard(term_id)];
+        const size_t slot = database.value_sharding.Slot(term_id);
+        return slot < frozen_shard.size() ? frozen_shard[slot] : source_util::PostingList<uint32_t>();
+    };
+    auto title_list = [&frozen_titles](size_t term_id) { return term_id < frozen_titles.size() ? frozen_titles[term_id] : source_util::PostingList<uint32_t>(); };
+    std::vector<uint32_t> term_ordinals(database.term_dictionary.size(), 0);
+    size_t ordinal_count = 0;
+    size_t value_byte_count = 0;
+    for (size_t term_id = 0; term_id < database.term_dictionary.size(); term_id++) {
+        const source_util::PostingList<uint32_t> value_postings = value_list(term_id);
+        if (value_postings.empty() == false || title_list(term_id).empty() == false) {
+            term_ordinals[term_id] = ordinal_count++;
+            value_byte_count += value_postings.byte_size();
+        }
+    }
+    segment.term_ids.reserve(ordinal_count);
+    segment.value_postings.Reserve(ordinal_count, value_byte_count);
+    segment.title_postings.Reserve(ordinal_count, frozen_titles.encoded_byte_count());
+    for (size_t term_id = 0; term_id < database.term_dictionary.size(); term_id++) {
+        const source_util::PostingList<uint32_t> value_postings = value_list(term_id);
+        const source_util::PostingList<uint32_t> title_postings = title_list(term_id);
+        if (value_postings.empty() == false || title_postings.empty() == false) {
+            segment.term_ids.push_back(term_id);
+            segment.value_postings.AppendEncoded(value_postings);
+            segment.title_postings.AppendEncoded(title_postings);
+        }
+    }
+    std::vector<source_util::PostingIndex<uint32_t>>().swap(this->frozen_shards_);
+
+    // The corpus statistics span every segment, so they are recomputed with the lengths of the new sources. The bounds of the older segments are scaled up by BlockMaxIndex::BoundScale wherever this made them too low.
+    database.value_lengths.Finalize();
+    database.title_lengths.Finalize();
+    segment.value_block_maxes.Build(segment.value_postings, database.value_lengths);
+    segment.title_block_maxes.Build(segment.title_postings, database.title_lengths);
+
+    // The positions were collected per parsing thread in parsing order, and are only sorted into ordinal order here, once every ordinal is known.
+    if (this->record_positions_ == true) {
+        segment.value_positions.Build(this->partial_value_positions_vec_, term_ordinals, ordinal_count);
+        std::vector<source_util::PositionRuns<uint32_t>>().swap(this->partial_value_positions_vec_);
+        segment.title_positions.Build(this->partial_title_positions_vec_, term_ordinals, ordinal_count);
+        std::vector<source_util::PositionRuns<uint32_t>>().swap(this->partial_title_positions_vec_);
+    }
+
+    this->posting_memory_stats_.posting_count = segment.value_postings.posting_count() + segment.title_postings.posting_count();
+    this->posting_memory_stats_.compressed_byte_count = segment.value_postings.byte_count() + segment.title_postings.byte_count();
+    this->posting_memory_stats_.block_max_byte_count = segment.value_block_maxes.byte_count() + segment.title_block_maxes.byte_count();
+    this->posting_memory_stats_.position_byte_count = segment.value_positions.byte_count() + segment.title_positions.byte_count();
+
+    // Hand the pages that held the ingest scaffolding back to the kernel, so the steady-state resident memory reflects what the database actually needs.
+    malloc_trim(0);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    this->freeze_stats_ = FreezeStats{
+        .seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count(),
+        .peak_rss_byte_count = (size_t)usage.ru_maxrss * 1024,
+        .steady_rss_byte_count = ResidentByteCount(),
+    };
+}
+
+template <typename ContainerPolicy>
+std::vector<search_engine::source_util::SegmentSize> search_engine::KaggleFinanceEngine<ContainerPolicy>::SegmentSizes() const {
+    std::vector<source_util::SegmentSize> sizes;
+    sizes.reserve(this->database_.segments.size());
+    for (auto&& segment : this->database_.segments) {
+        const size_t live_count = segment.end_document_id - segment.first_document_id - this->database_.document_table.DeletedCount(segment.first_document_id, segment.end_document_id);
+        sizes.push_back(source_util::SegmentSize{.live_count = live_count, .deleted_count = segment.document_count - live_count});
+    }
+    return sizes;
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::MergeSegments(size_t first_segment, size_t end_segment, Segment& merged_segment) const {
+    const Database& database = this->database_;
+    const source_util::DocumentTable& document_table = database.document_table;
+    merged_segment.first_document_id = database.segments[first_segment].first_document_id;
+    merged_segment.end_document_id = database.segments[end_segment - 1].end_document_id;
+    merged_segment.document_count = merged_segment.end_document_id - merged_segment.first_document_id - document_table.DeletedCount(merged_segment.first_document_id, merged_segment.end_document_id);
+
+    // The segments hold increasing ranges of document IDs, so the lists of a term are merged by concatenating its lists in segment order, without their deleted documents.
+    std::vector<uint32_t> term_ids;
+    bool has_value_positions = true;
+    bool has_title_positions = true;
+    for (size_t i = first_segment; i < end_segment; i++) {
+        term_ids.insert(term_ids.end(), database.segments[i].term_ids.begin(), database.segments[i].term_ids.end());
+        has_value_positions = has_value_positions == true && database.segments[i].value_positions.empty() == false;
+        has_title_positions = has_title_positions == true && database.segments[i].title_positions.empty() == false;
+    }
+    std::sort(term_ids.begin(), term_ids.end());
+    term_ids.erase(std::unique(term_ids.begin(), term_ids.end()), term_ids.end());
+
+    struct MergedField {
+        source_util::PostingIndex<uint32_t> Segment::*postings;
+        source_util::PositionIndex<uint32_t> Segment::*positions;
+        bool has_positions;
+        std::vector<std::pair<uint32_t, uint32_t>> term_postings;  // the postings of the current term
+        std::vector<uint8_t> term_position_entries;                 // the position entries of the documents of term_postings
+    };
+    MergedField fields[2] = {
+        {.postings = &Segment::value_postings, .positions = &Segment::value_positions, .has_positions = has_value_positions, .term_postings = {}, .term_position_entries = {}},
+        {.postings = &Segment::title_postings, .positions = &Segment::title_positions, .has_positions = has_title_positions, .term_postings = {}, .term_position_entries = {}},
+    };
+    std::vector<size_t> ordinals(end_segment - first_segment, 0);  // the ordinal of the current term, or of the next term after it, in every segment
+    merged_segment.term_ids.reserve(term_ids.size());
+    for (auto&& term_id : term_ids) {
+        for (auto&& field : fields) {
+            field.term_postings.clear();
+            field.term_position_entries.clear();
+        }
+        for (size_t i = first_segment; i < end_segment; i++) {
+            const Segment& segment = database.segments[i];
+            size_t& ordinal = ordinals[i - first_segment];
+            if (ordinal == segment.term_ids.size() || segment.term_ids[ordinal] != term_id) {
+                continue;
+            }
+            for (auto&& field : fields) {
+                const uint8_t* entry = field.has_positions == true ? (segment.*field.positions)[ordinal].data() : nullptr;
+                for (auto&& posting : (segment.*field.postings)[ordinal]) {
+                    const uint8_t* const entry_start = entry;
+                    if (field.has_positions == true) {
+                        const size_t entry_byte_count = source_util::PostingList<uint32_t>::ReadVarint(entry);
+                        entry += entry_byte_count;
+                    }
+                    if (document_table.IsDeleted(posting.first) == true) {
+                        continue;
+                    }
+                    field.term_postings.push_back(posting);
+                    if (field.has_positions == true) {
+                        field.term_position_entries.insert(field.term_position_entries.end(), entry_start, entry);
+                    }
+                }
+            }
+            ordinal++;
+        }
+        // A term whose documents have all been deleted is left out of the merged segment.
+        if (fields[0].term_postings.empty() == true && fields[1].term_postings.empty() == true) {
             continue;
         }
-        pthread_mutex_lock(&thread_args->obj_ptr->alpha_buffer_mutex_[thread_args->buffer_subscript]);
-        const AlphaBufferArgs word_args = std::move(thread_args->obj_ptr->alpha_buffer_[thread_args->buffer_subscript].front());
-        thread_args->obj_ptr->alpha_buffer_[thread_args->buffer_subscript].pop();
-        pthread_mutex_unlock(&thread_args->obj_ptr->alpha_buffer_mutex_[thread_args->buffer_subscript]);
+        merged_segment.term_ids.push_back(term_id);
+        for (auto&& field : fields) {
+            (merged_segment.*field.postings).Append(field.term_postings);
+            if (field.has_positions == true) {
+                (merged_segment.*field.positions).AppendEncoded(field.term_position_entries.data(), field.term_position_entries.size());
+            }
+        }
+    }
+    merged_segment.value_postings.ShrinkToFit();
+    merged_segment.title_postings.ShrinkToFit();
+    merged_segment.value_block_maxes.Build(merged_segment.value_postings, database.value_lengths);
+    merged_segment.title_block_maxes.Build(merged_segment.title_postings, database.title_lengths);
+
+    for (size_t i = 0; i < kMergedIndexCount - 1; i++) {
+        typename IngestSegment::MetadataIndex metadata_index;
+        for (size_t j = first_segment; j < end_segment; j++) {
+            for (auto&& metadata_document_id_set_pair : database.segments[j].*kMetadataIndexes[i]) {
+                for (auto&& document_id : metadata_document_id_set_pair.second) {
+                    if (document_table.IsDeleted(document_id) == false) {
+                        metadata_index[metadata_document_id_set_pair.first].emplace(document_id);
+                    }
+                }
+            }
+        }
+        merged_segment.*kMetadataIndexes[i] = source_util::ConvertIndex<typename Database::MetadataIndex>(std::move(metadata_index));
+    }
+}
 
-        thread_args->obj_ptr->database_.value_index[thread_args->buffer_subscript][word_args.word].emplace(thread_args->obj_ptr->unformatted_database_[word_args.file_subscript].first, word_args.count);
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::ReplaceSegments(size_t first_segment, size_t end_segment, Segment&& merged_segment, double seconds) {
+    std::vector<Segment>& segments = this->database_.segments;
+    size_t document_count = 0;
+    for (size_t i = first_segment; i < end_segment; i++) {
+        document_count += segments[i].document_count;
     }
+    this->merge_stats_.merge_count++;
+    this->merge_stats_.merged_document_count += merged_segment.document_count;
+    this->merge_stats_.dropped_document_count += document_count - merged_segment.document_count;
+    this->merge_stats_.seconds += seconds;
+    segments[first_segment] = std::move(merged_segment);
+    segments.erase(segments.begin() + first_segment + 1, segments.begin() + end_segment);
+}
+
+template <typename ContainerPolicy>
+void* search_engine::KaggleFinanceEngine<ContainerPolicy>::SegmentMergingThreadFunc(void* _arg) {
+    SegmentMergingThreadArgs* const thread_args = (SegmentMergingThreadArgs*)_arg;
+    const auto start_time = std::chrono::steady_clock::now();
+    thread_args->obj_ptr->MergeSegments(thread_args->first_segment, thread_args->end_segment, thread_args->merged_segment);
+    thread_args->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    thread_args->finished.store(true, std::memory_order_release);
     return NULL;
-}
\ No newline at end of file
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::StartMerge() {
+    if (this->segment_merge_ != nullptr || this->merge_policy_.has_value() == false) {
+        return;
+    }
+    const std::pair<size_t, size_t> merge = this->merge_policy_->FindMerge(this->SegmentSizes());
+    if (merge.first == merge.second) {
+        return;
+    }
+    this->segment_merge_ = std::make_unique<SegmentMergingThreadArgs>();
+    this->segment_merge_->obj_ptr = this;
+    this->segment_merge_->first_segment = merge.first;
+    this->segment_merge_->end_segment = merge.second;
+    this->segment_merge_->seconds = 0;
+    this->segment_merge_->finished.store(false, std::memory_order_relaxed);
+    pthread_create(&this->segment_merging_thread_, NULL, this->SegmentMergingThreadFunc, (void*)this->segment_merge_.get());
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::FinishMerge() {
+    if (this->segment_merge_ == nullptr) {
+        return;
+    }
+    pthread_join(this->segment_merging_thread_, NULL);
+    std::unique_ptr<SegmentMergingThreadArgs> segment_merge = std::move(this->segment_merge_);
+    this->ReplaceSegments(segment_merge->first_segment, segment_merge->end_segment, std::move(segment_merge->merged_segment), segment_merge->seconds);
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::ApplyFinishedMerges() {
+    // A merge that is still running is left alone, so a query never waits for one.
+    if (this->segment_merge_ != nullptr && this->segment_merge_->finished.load(std::memory_order_acquire) == true) {
+        this->FinishMerge();
+        this->StartMerge();
+    }
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::WaitForMerges() {
+    this->FinishMerge();
+    this->StartMerge();
+    while (this->segment_merge_ != nullptr) {
+        this->FinishMerge();
+        this->StartMerge();
+    }
+}
+
+template <typename ContainerPolicy>
+void search_engine::KaggleFinanceEngine<ContainerPolicy>::ForceMerge(size_t max_segment_count) {
+    this->FinishMerge();
+    // The groups of neighbouring segments to merge are picked first, by repeatedly joining the two neighbouring groups with the fewest documents, so every document is only rewritten once.
+    const std::vector<source_util::SegmentSize> sizes = this->SegmentSizes();
+    std::vector<std::pair<size_t, size_t>> groups;  // {first segment, document count}
+    for (size_t i = 0; i < sizes.size(); i++) {
+        groups.emplace_back(i, sizes[i].live_count + sizes[i].deleted_count);
+    }
+    while (groups.size() > std::max<size_t>(max_segment_count, 1)) {
+        size_t best = 0;
+        for (size_t i = 1; i + 1 < groups.size(); i++) {
+            if (groups[i].second + groups[i + 1].second < groups[best].second + groups[best + 1].second) {
+                best = i;
+            }
+        }
+        groups[best].second += groups[best + 1].second;
+        groups.erase(groups.begin() + best + 1);
+    }
+    // The groups are merged from the last to the first, so the subscripts of the groups that are left stay valid.
+    for (size_t i = groups.size(); i-- > 0;) {
+        const size_t end_segment = i + 1 < groups.size() ? groups[i + 1].first : sizes.size();
+        if (end_segment - groups[i].first < 2) {
+            continue;
+        }
+        const auto start_time = std::chrono::steady_clock::now();
+        Segment merged_segment;
+        this->MergeSegments(groups[i].first, end_segment, merged_segment);
+        this->ReplaceSegments(groups[i].first, end_segment, std::move(merged_segment), std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count());
+    }
+}
+
+template <typename ContainerPolicy>
+size_t search_engine::KaggleFinanceEngine<ContainerPolicy>::ResidentByteCount() {
+    size_t total_page_count = 0;
+    size_t resident_page_count = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> total_page_count >> resident_page_count;
+    return resident_page_count * sysconf(_SC_PAGESIZE);
+}
+
+template <typename ContainerPolicy>
+size_t search_engine::KaggleFinanceEngine<ContainerPolicy>::ApproximateByteCount(const PostingMap& postings) {
+    if constexpr (std::is_same_v<PostingMap, std::unordered_map<uint32_t, uint32_t>>) {
+        // Every element lives in its own heap node holding the next pointer and the pair, which malloc rounds up to 16 bytes plus an 8-byte header, and every bucket is one pointer.
+        const size_t node_byte_count = (sizeof(void*) + sizeof(std::pair<const uint32_t, uint32_t>) + 8 + 15) / 16 * 16;
+        return postings.size() * node_byte_count + (postings.bucket_count() > 1 ? postings.bucket_count() * sizeof(void*) : 0);
+    } else {
+        return postings.byte_count();
+    }
+}
+
+template class search_engine::KaggleFinanceEngine<search_engine::source_util::StdContainerPolicy>;
+template class search_engine::KaggleFinanceEngine<search_engine::source_util::FlatContainerPolicy>;
+template class search_engine::KaggleFinanceEngine<search_engine::source_util::CompactContainerPolicy>;
\ No newline at end of file
@@ -1,70 +1,278 @@
 #ifndef SEARCH_ENGINE_PROJECT_KAGGLEFINANCESOURCEENGINE_H_
 #define SEARCH_ENGINE_PROJECT_KAGGLEFINANCESOURCEENGINE_H_
 
-#include <semaphore.h>
+#include <pthread.h>
 
+#include <atomic>
 #include <cstdint>
 #include <filesystem>
+#include <limits>
+#include <memory>
 #include <optional>
-#include <queue>
 
+#include "IndexFile.h"
+#include "MergePolicy.h"
+#include "MpscRingBuffer.h"
 #include "SourceEngine.h"
 
 namespace search_engine {
 
 /*!
  * @brief The KaggleFinanceEngine class should be used to manage and parse the data found at https://www.kaggle.com/datasets/jeet2016/us-financial-news-articles
- * @attention The KaggleFinanceEngine is a child of the search_engine::source_util::SourceEngine<size_t, size_t, std::string> classs.
+ * @attention The KaggleFinanceEngine is a child of the search_engine::source_util::SourceEngine<uint32_t, uint32_t, std::string, ContainerPolicy> classs.
  * @warning The KaggleFinanceEngine class utilizes POSIX threads, and therefore is only compatible with Linux systems.
+ * @tparam ContainerPolicy The containers of the RunTimeDatabase object that is filled. The engine is explicitly instantiated for source_util::StdContainerPolicy, source_util::FlatContainerPolicy and source_util::CompactContainerPolicy.
  */
-class KaggleFinanceEngine : public source_util::SourceEngine<size_t, size_t, std::string> {
+template <typename ContainerPolicy = source_util::StdContainerPolicy>
+class KaggleFinanceEngine : public source_util::SourceEngine<uint32_t, uint32_t, std::string, ContainerPolicy> {
    public:
-    explicit KaggleFinanceEngine(size_t parse_amount, size_t fill_amount);
-    void ParseSources(std::string file_path, const std::unordered_set<size_t>* const stop_words = NULL) override;
+    using Database = source_util::RunTimeDatabase<uint32_t, uint32_t, std::string, ContainerPolicy>;
+    using Segment = typename Database::Segment;
+
+    /*!
+     * @param record_positions Whether the position of every value and title token is recorded into value_positions and title_positions, which lets phrase queries match exact phrases at the cost of a larger index.
+     * @param merge_policy The policy that picks which segments are merged in the background, or std::nullopt to only merge them through ForceMerge.
+     */
+    explicit KaggleFinanceEngine(size_t parse_amount, size_t fill_amount, bool record_positions = false, std::optional<source_util::TieredMergePolicy> merge_policy = source_util::TieredMergePolicy());
+    ~KaggleFinanceEngine() override;
+    void ParseSources(std::string file_path, const std::unordered_set<std::string>* const stop_words = NULL) override;
     void DisplaySource(std::string file_path, bool just_header) override;
-    inline void ClearRuntimeDatabase() override;
-    size_t CleanID(const char* const id_token, std::optional<size_t> size = std::nullopt) override;
-    size_t CleanValue(const char* const value_token, std::optional<size_t> size = std::nullopt) override;
+    void ClearRuntimeDatabase() override;
+    uint32_t CleanValue(const char* const value_token, std::optional<size_t> size = std::nullopt) override;
     std::string CleanMetaData(const char* const metadata_token, std::optional<size_t> size = std::nullopt) override;
-    inline const source_util::RunTimeDatabase<size_t, size_t, std::string>* const GetRuntimeDatabase() const override { return &database_; };
+    std::vector<uint32_t> CleanPhrase(const char* const phrase, size_t size) override;
+    inline const Database* GetRuntimeDatabase() const override { return &database_; };
+    void ApplyFinishedMerges() override;
+
+    /*!
+     * @brief Blocks until the background merge, and every merge the merge policy picks after it, has been applied.
+     */
+    void WaitForMerges();
+
+    /*!
+     * @brief Merges neighbouring segments, smallest pairs first, on the calling thread until the database holds at most max_segment_count segments.
+     */
+    void ForceMerge(size_t max_segment_count);
+
+    /*!
+     * @brief Writes the database, with every one of its segments, to an index file at the given path, which LoadIndex can then load instead of parsing the sources again.
+     * @return Whether the whole file was written. If not, an error has been printed and no file is left at the given path.
+     */
+    bool SaveIndex(const std::string& index_path) const;
+
+    /*!
+     * @brief Replaces the database with the one in the index file at the given path, which SaveIndex wrote with any container policy.
+     * @details The file is mapped read-only and shared, and the term dictionary, the document table, and the postings, block maxes and positions of every segment are read straight out of it, so they are only ever loaded into memory page by page as queries read them, and are shared with every other process that maps the same file. Only the document lengths, the deleted documents and the meta-data indexes are copied into the containers of the database. ParseSources can then add the sources that are new or have changed since the file was written as a new segment, without parsing the others again.
+     * @return Whether the file was loaded. If not, an error has been printed and the database is left empty.
+     */
+    bool LoadIndex(const std::string& index_path);
+
+    /*!
+     * @brief The amount of work a single parsing thread did during the last call to ParseSources.
+     */
+    struct ParsingThreadStats {
+        size_t batch_count = 0;
+        size_t file_count = 0;
+        uintmax_t byte_count = 0;
+        double seconds = 0;
+    };
+
+    /*!
+     * @brief Returns one ParsingThreadStats entry per parsing thread for the last call to ParseSources.
+     */
+    inline const std::vector<ParsingThreadStats>& GetParsingThreadStats() const { return parsing_thread_stats_; }
+
+    /*!
+     * @brief How the sources the last call to ParseSources found compare to the ones already in the database.
+     */
+    struct SourceChangeStats {
+        size_t new_count = 0;        // parsed for the first time
+        size_t changed_count = 0;    // parsed again, and their old documents deleted
+        size_t removed_count = 0;    // not found anymore, and their documents deleted
+        size_t unchanged_count = 0;  // skipped
+    };
+
+    inline const SourceChangeStats& GetSourceChangeStats() const { return source_change_stats_; }
+
+    /*!
+     * @brief The memory taken by the value and title postings of the segment the last call to ParseSources added, as hash maps and once compressed.
+     */
+    struct PostingMemoryStats {
+        size_t posting_count = 0;
+        size_t hash_map_byte_count = 0;  // an estimate, since the allocator overhead of the hash map nodes is not observable
+        size_t compressed_byte_count = 0;
+        size_t block_max_byte_count = 0;  // the BM25 upper bounds and skip data of the compressed postings
+        size_t position_byte_count = 0;   // the compressed token positions, which are only recorded if the engine was asked to
+    };
+
+    inline const PostingMemoryStats& GetPostingMemoryStats() const { return posting_memory_stats_; }
+
+    /*!
+     * @brief How long the freeze at the end of the last call to ParseSources took, and the resident memory of the process before and after it.
+     */
+    struct FreezeStats {
+        double seconds = 0;
+        size_t peak_rss_byte_count = 0;    // the most memory the process has held so far, which is reached while parsing
+        size_t steady_rss_byte_count = 0;  // the memory the process holds once the ingest scaffolding has been released
+    };
+
+    inline const FreezeStats& GetFreezeStats() const { return freeze_stats_; }
+
+    /*!
+     * @brief How long the last call to LoadIndex took, and the resident memory of the process once it returned.
+     */
+    struct LoadStats {
+        double seconds = 0;
+        size_t file_byte_count = 0;        // the size of the index file, all of which is mapped
+        size_t steady_rss_byte_count = 0;  // which only counts the pages of the file that have been read so far
+    };
+
+    inline const LoadStats& GetLoadStats() const { return load_stats_; }
+
+    /*!
+     * @brief Every merge that has been applied to the database since the engine was created.
+     */
+    struct MergeStats {
+        size_t merge_count = 0;
+        size_t merged_document_count = 0;   // the documents written by the merges, summed over every merge
+        size_t dropped_document_count = 0;  // the deleted documents the merges dropped
+        double seconds = 0;                 // spent building the merged segments, whether in the background or not
+    };
+
+    inline const MergeStats& GetMergeStats() const { return merge_stats_; }
 
    private:
-    struct ParsingThreadArgs {
-        KaggleFinanceEngine* obj_ptr;
-        const std::unordered_set<size_t>* stop_words_ptr;
+    // The partial segments that the parsing threads fill share the term and document IDs of database_, but keep their meta-data in containers that can be inserted into.
+    using IngestSegment = source_util::Segment<uint32_t, std::string, typename ContainerPolicy::IngestPolicy>;
+    using PostingMap = typename Database::PostingMap;
+
+    struct ParsingBatch {
         size_t start;
         size_t end;
+        uintmax_t byte_count;
+    };
+    struct ParsingThreadArgs {
+        KaggleFinanceEngine* obj_ptr;
+        const std::unordered_set<uint32_t>* stop_term_ids_ptr;
+        const std::vector<ParsingBatch>* batches_ptr;
+        std::atomic<size_t>* batch_cursor_ptr;
         size_t file_buffer_subscript;
     };
     struct FillingThreadArgs {
         KaggleFinanceEngine* obj_ptr;
         size_t buffer_subscript;
     };
+    struct FreezingThreadArgs {
+        KaggleFinanceEngine* obj_ptr;
+        size_t shard_subscript;  // value_index[shard_subscript], or title_index for filling_thread_count_, is encoded into frozen_shards_[shard_subscript]
+        size_t hash_map_byte_count;
+    };
+    struct MergingThreadArgs {
+        KaggleFinanceEngine* obj_ptr;
+        size_t index_subscript;  // 0 merges partial_title_postings_vec_ into title_index, and anything above merges kMetadataIndexes[index_subscript - 1]
+    };
+    struct TitlePosting {
+        uint32_t term_id;
+        uint32_t document_id;
+    };
+    // The occurrences of one term in the text of the article being parsed.
+    struct TermOccurrences {
+        uint32_t count = 0;
+        uint32_t slot = 0;  // how many other distinct terms came before the term's first occurrence in the article
+    };
+    struct SegmentMergingThreadArgs {
+        KaggleFinanceEngine* obj_ptr;
+        size_t first_segment;  // the segments [first_segment, end_segment) of database_ are merged into merged_segment
+        size_t end_segment;
+        Segment merged_segment;
+        double seconds;
+        std::atomic<bool> finished;  // set by the merging thread once merged_segment is complete
+    };
     struct AlphaBufferArgs {
-        size_t file_subscript;
-        size_t word;
-        uint32_t count;
+        size_t document_id;
+        std::vector<std::pair<uint32_t, uint32_t>> words;  // {term ID, count} pairs of one article that belong to the receiving filling thread's shard
     };
 
-    void ParseSingleArticle(const size_t file_subscript, const std::unordered_set<size_t>* const stop_words_ptr, size_t file_buffer_subscript);
+    void ParseSingleArticle(const size_t file_subscript, const std::unordered_set<uint32_t>* const stop_term_ids_ptr, size_t file_buffer_subscript);
     static void* ParsingThreadFunc(void* _arg);
-    static void* ArbitratorThreadFunc(void* _arg);
     static void* FillingThreadFunc(void* _arg);
+    static void* MergingThreadFunc(void* _arg);
+    static void* FreezingThreadFunc(void* _arg);
+    static void* SegmentMergingThreadFunc(void* _arg);
+    // Encodes value_index and title_index into the value_postings and title_postings of the last segment with one thread per shard, computes the BM25 norms of every document and the BM25 upper bounds of every posting list of the segment, sorts the recorded positions into its value_positions and title_positions, and then releases everything that was only needed while parsing.
+    void Freeze();
+    // The resident memory of the process, in bytes.
+    static size_t ResidentByteCount();
+    static size_t ApproximateByteCount(const PostingMap& postings);
+    // The sizes of the segments of database_, as merge_policy_ sees them.
+    std::vector<source_util::SegmentSize> SegmentSizes() const;
+    // Builds the segment that holds every document of the segments [first_segment, end_segment) of database_ that is not deleted. Only reads database_, so it can run while the database is queried.
+    void MergeSegments(size_t first_segment, size_t end_segment, Segment& merged_segment) const;
+    // Replaces the segments [first_segment, end_segment) of database_ with merged_segment.
+    void ReplaceSegments(size_t first_segment, size_t end_segment, Segment&& merged_segment, double seconds);
+    // Starts a background merge of the segments merge_policy_ picks, unless a merge is already running or none is due.
+    void StartMerge();
+    // Waits for the background merge, if one is running, and applies it.
+    void FinishMerge();
+    // Writes every index of the given segment to an index file.
+    static void WriteSegment(const Segment& segment, source_util::IndexFileWriter& writer);
+    // Makes segment a view of a segment that WriteSegment wrote, and returns whether the file held a well-formed one for a dictionary of term_count terms.
+    static bool MapSegment(source_util::IndexFileReader& reader, size_t term_count, Segment& segment);
+    // Writes the given meta-data index to an index file as its values, in sorted order, followed by the sorted document IDs of every value.
+    static void WriteMetadataIndex(const typename Database::MetadataIndex& metadata_index, source_util::IndexFileWriter& writer);
+    // Rebuilds a meta-data index that WriteMetadataIndex wrote into metadata_index, and returns whether the file held a well-formed one.
+    static bool ReadMetadataIndex(source_util::IndexFileReader& reader, typename Database::MetadataIndex& metadata_index);
+
+    // Pushed into every alpha_buffer_ queue once all parsing threads have joined, so the blocked filling threads wake up and exit.
+    static constexpr size_t kEndOfStream = std::numeric_limits<size_t>::max();
+    // ParseSources splits the corpus into about this many equally sized (in bytes) batches per parsing thread.
+    static constexpr size_t kBatchesPerParsingThread = 16;
+    // The amount of article batches each alpha_buffer_ ring buffer holds before the parsing threads block, which bounds ingest memory when the filling threads fall behind.
+    static constexpr size_t kAlphaBufferCapacity = 1024;
+    static constexpr typename Segment::MetadataIndex Segment::*kMetadataIndexes[] = {
+        &Segment::site_index,
+        &Segment::language_index,
+        &Segment::location_index,
+        &Segment::person_index,
+        &Segment::organization_index,
+        &Segment::author_index,
+        &Segment::country_index,
+    };
+    // The same indexes as kMetadataIndexes, in the same order, in the partial segments.
+    static constexpr typename IngestSegment::MetadataIndex IngestSegment::*kIngestMetadataIndexes[] = {
+        &IngestSegment::site_index,
+        &IngestSegment::language_index,
+        &IngestSegment::location_index,
+        &IngestSegment::person_index,
+        &IngestSegment::organization_index,
+        &IngestSegment::author_index,
+        &IngestSegment::country_index,
+    };
+    // title_index, plus every index in kMetadataIndexes.
+    static constexpr size_t kMergedIndexCount = 1 + sizeof(kMetadataIndexes) / sizeof(kMetadataIndexes[0]);
 
-    source_util::RunTimeDatabase<size_t, size_t, std::string> database_;
-    std::vector<std::pair<size_t, std::unordered_map<size_t, uint32_t>>> unformatted_database_;
-    std::vector<std::filesystem::__cxx11::path> files_;
+    Database database_;
+    std::vector<std::filesystem::__cxx11::path> files_;  // the sources of the segment being parsed, where the source at subscript i becomes document ID first_document_id + i of the segment, only populated while ParseSources runs
     size_t parsing_thread_count_;
     size_t filling_thread_count_;
-    std::queue<size_t> arbitrator_buffer_;
-    std::vector<std::queue<AlphaBufferArgs>> alpha_buffer_;
-    bool currently_parsing_ = false;
-    sem_t production_state_sem_;
-    std::vector<sem_t> arbitrator_sem_vec_;
-    pthread_mutex_t arbitrator_buffer_mutex_;
-    pthread_mutex_t metadata_mutex_;
-    std::vector<pthread_mutex_t> alpha_buffer_mutex_;
+    bool record_positions_;
+    std::vector<std::unique_ptr<source_util::MpscRingBuffer<AlphaBufferArgs>>> alpha_buffer_;
+    std::vector<IngestSegment> partial_segment_vec_;                                // one per parsing thread, only populated while ParseSources runs
+    std::vector<std::vector<TitlePosting>> partial_title_postings_vec_;             // one per parsing thread, only populated while ParseSources runs
+    std::vector<source_util::PositionRuns<uint32_t>> partial_value_positions_vec_;  // one per parsing thread, only populated while ParseSources runs with record_positions_
+    std::vector<source_util::PositionRuns<uint32_t>> partial_title_positions_vec_;  // one per parsing thread, only populated while ParseSources runs with record_positions_
     std::vector<std::pair<char*, size_t>> file_buffer_array_;
+    std::vector<ParsingThreadStats> parsing_thread_stats_;
+    SourceChangeStats source_change_stats_;
+    std::vector<source_util::PostingIndex<uint32_t>> frozen_shards_;  // one per value_index shard, where list i of shard s holds the postings of term ID database_.value_sharding.TermId(s, i), followed by title_index, whose list i holds the postings of term ID i, only populated while Freeze runs
+    PostingMemoryStats posting_memory_stats_;
+    FreezeStats freeze_stats_;
+    LoadStats load_stats_;
+    std::optional<source_util::TieredMergePolicy> merge_policy_;
+    std::unique_ptr<SegmentMergingThreadArgs> segment_merge_;  // the running background merge, or nullptr
+    pthread_t segment_merging_thread_;
+    MergeStats merge_stats_;
+    std::unique_ptr<source_util::MappedIndexFile> index_file_;  // the index file that LoadIndex mapped, which the database reads from until it is cleared
 };
 
 }  // namespace search_engine
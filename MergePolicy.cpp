@@ -0,0 +1,35 @@
+#include "MergePolicy.h"
+
+size_t search_engine::source_util::TieredMergePolicy::Tier(const SegmentSize& size) const {
+    size_t tier = 0;
+    for (size_t bound = this->floor_live_count; size.live_count >= bound && tier < 64; bound *= this->segments_per_tier) {
+        tier++;
+    }
+    return tier;
+}
+
+std::pair<size_t, size_t> search_engine::source_util::TieredMergePolicy::FindMerge(const std::vector<SegmentSize>& sizes) const {
+    for (size_t i = 0; i < sizes.size(); i++) {
+        const size_t document_count = sizes[i].live_count + sizes[i].deleted_count;
+        if (sizes[i].deleted_count > 0 && sizes[i].deleted_count >= this->max_deleted_fraction * document_count) {
+            return {i, i + 1};
+        }
+    }
+    if (this->segments_per_tier < 2) {
+        return {0, 0};
+    }
+    // The oldest segments_per_tier segments of the newest run of neighbours that share a tier and is long enough, so that the merged segment ends up before the smaller segments of the run.
+    size_t run_end = sizes.size();
+    while (run_end > 0) {
+        const size_t tier = this->Tier(sizes[run_end - 1]);
+        size_t run_start = run_end - 1;
+        while (run_start > 0 && this->Tier(sizes[run_start - 1]) == tier) {
+            run_start--;
+        }
+        if (run_end - run_start >= this->segments_per_tier) {
+            return {run_start, run_start + this->segments_per_tier};
+        }
+        run_end = run_start;
+    }
+    return {0, 0};
+}
\ No newline at end of file
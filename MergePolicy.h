@@ -0,0 +1,42 @@
+#ifndef SEARCH_ENGINE_PROJECT_MERGEPOLICY_H_
+#define SEARCH_ENGINE_PROJECT_MERGEPOLICY_H_
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief The size of one segment, as a merge policy sees it.
+ */
+struct SegmentSize {
+    size_t live_count;     // the documents of the segment that are not deleted
+    size_t deleted_count;  // the deleted documents that the segment still holds postings for
+};
+
+/*!
+ * @brief Picks which segments of a RunTimeDatabase to merge, by grouping them into tiers of live document counts that grow by a factor of segments_per_tier from one tier to the next.
+ * @details Segments are only ever merged with their neighbours, so that every segment keeps a contiguous range of document IDs. New segments are added after the older ones, so the segments stay ordered from the largest tier to the smallest, and segments_per_tier neighbours of the same tier are merged into one segment of the next tier. A document is therefore rewritten about once per tier it climbs, which is O(log n) times over the life of the database, and a database of n documents holds O(segments_per_tier * log n) segments. A segment whose share of deleted documents reaches max_deleted_fraction is rewritten on its own, which drops them.
+ */
+struct TieredMergePolicy {
+    size_t segments_per_tier = 10;
+    size_t floor_live_count = 1000;  // every segment with fewer live documents than this is in the lowest tier
+    double max_deleted_fraction = 0.25;
+
+    // The tier of a segment of the given size, where tier 0 holds the smallest segments.
+    size_t Tier(const SegmentSize& size) const;
+
+    /*!
+     * @brief Picks the next merge for segments of the given sizes, in document ID order.
+     * @return The range [first, end) of the subscripts of the segments to merge into one, which is empty if no merge is due.
+     */
+    std::pair<size_t, size_t> FindMerge(const std::vector<SegmentSize>& sizes) const;
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_MERGEPOLICY_H_
\ No newline at end of file
@@ -0,0 +1,96 @@
+#ifndef SEARCH_ENGINE_PROJECT_MPSCRINGBUFFER_H_
+#define SEARCH_ENGINE_PROJECT_MPSCRINGBUFFER_H_
+
+#include <sched.h>
+#include <semaphore.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <memory>
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief A bounded, lock-free ring buffer that any number of threads may push into and exactly one thread may pop from.
+ * @details Slots are claimed with a single atomic increment and published through a per-slot sequence number, so producers never take a lock. Two POSIX semaphores count the free and the filled slots; they only enter the kernel when a producer has to wait for room (back-pressure) or the consumer has to wait for data.
+ * @tparam T The type of the elements stored in the ring buffer. It must be default constructible and move assignable.
+ */
+template <typename T>
+class MpscRingBuffer {
+   public:
+    /*!
+     * @param capacity The maximum amount of elements the ring buffer can hold before Push blocks. It is rounded up to the next power of two.
+     */
+    explicit MpscRingBuffer(size_t capacity) {
+        size_t rounded_capacity = 1;
+        while (rounded_capacity < capacity) {
+            rounded_capacity <<= 1;
+        }
+        this->mask_ = rounded_capacity - 1;
+        this->slots_ = std::make_unique<Slot[]>(rounded_capacity);
+        for (size_t i = 0; i < rounded_capacity; i++) {
+            this->slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        sem_init(&this->free_slot_sem_, 0, rounded_capacity);
+        sem_init(&this->used_slot_sem_, 0, 0);
+    }
+    MpscRingBuffer(const MpscRingBuffer&) = delete;
+    MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+    ~MpscRingBuffer() {
+        sem_destroy(&this->free_slot_sem_);
+        sem_destroy(&this->used_slot_sem_);
+    }
+
+    /*!
+     * @brief Moves the given value into the ring buffer, blocking while the ring buffer is full. Safe to call from any number of threads.
+     */
+    void Push(T&& value) {
+        while (sem_wait(&this->free_slot_sem_) == -1 && errno == EINTR) {
+        }
+        const size_t position = this->tail_.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = this->slots_[position & this->mask_];
+        slot.value = std::move(value);
+        slot.sequence.store(position + 1, std::memory_order_release);
+        sem_post(&this->used_slot_sem_);
+    }
+
+    /*!
+     * @brief Removes and returns the oldest value in the ring buffer, blocking while the ring buffer is empty.
+     * @warning Must only ever be called by one thread at a time.
+     */
+    T Pop() {
+        while (sem_wait(&this->used_slot_sem_) == -1 && errno == EINTR) {
+        }
+        Slot& slot = this->slots_[this->head_ & this->mask_];
+        // The post we consumed may belong to a producer that claimed a later slot; the producer of this slot has already claimed it and is only a few instructions away from publishing it.
+        while (slot.sequence.load(std::memory_order_acquire) != this->head_ + 1) {
+            sched_yield();
+        }
+        T value = std::move(slot.value);
+        slot.sequence.store(this->head_ + this->mask_ + 1, std::memory_order_release);
+        this->head_++;
+        sem_post(&this->free_slot_sem_);
+        return value;
+    }
+
+   private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> tail_ = 0;
+    alignas(64) size_t head_ = 0;
+    sem_t free_slot_sem_;
+    sem_t used_slot_sem_;
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_MPSCRINGBUFFER_H_
@@ -0,0 +1,228 @@
+#ifndef SEARCH_ENGINE_PROJECT_POSITIONINDEX_H_
+#define SEARCH_ENGINE_PROJECT_POSITIONINDEX_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "IndexFile.h"
+#include "PostingList.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief The positions of terms in the documents one parsing thread has parsed, in the order they were added.
+ * @details The positions of each {term, document} pair are encoded as soon as they are added, in the layout of a PositionIndex entry, so collecting them costs a few bytes per token and one Run per posting.
+ * @tparam T The unsigned integer type used for the document IDs.
+ */
+template <typename T>
+class PositionRuns {
+   public:
+    struct Run {
+        uint32_t term_id;
+        T document_id;
+        size_t byte_offset;  // the offset of the encoded positions in bytes()
+    };
+
+    /*!
+     * @brief Adds the position_count positions of a term in a document, which must be sorted in increasing order.
+     */
+    void Add(uint32_t term_id, T document_id, const uint32_t* positions, size_t position_count) {
+        this->runs_.push_back(Run{.term_id = term_id, .document_id = document_id, .byte_offset = this->bytes_.size()});
+        this->scratch_.clear();
+        uint32_t previous_position = 0;
+        for (size_t i = 0; i < position_count; i++) {
+            PostingList<T>::WriteVarint(this->scratch_, positions[i] - previous_position);
+            previous_position = positions[i];
+        }
+        PostingList<T>::WriteVarint(this->bytes_, this->scratch_.size());
+        this->bytes_.insert(this->bytes_.end(), this->scratch_.begin(), this->scratch_.end());
+    }
+
+    inline const std::vector<Run>& runs() const { return this->runs_; }
+    inline const uint8_t* bytes() const { return this->bytes_.data(); }
+    inline size_t byte_size() const { return this->bytes_.size(); }
+
+    inline void Clear() {
+        this->runs_ = std::vector<Run>();
+        this->bytes_ = std::vector<uint8_t>();
+        this->scratch_ = std::vector<uint8_t>();
+    }
+
+   private:
+    std::vector<Run> runs_;
+    std::vector<uint8_t> bytes_;
+    std::vector<uint8_t> scratch_;  // reused by Add to encode the positions before their byte size is known
+};
+
+/*!
+ * @brief A read-only view of the positions of one term in every document of its posting list.
+ */
+class PositionList {
+   public:
+    PositionList() : data_(nullptr), end_(nullptr) {}
+    PositionList(const uint8_t* data, const uint8_t* end) : data_(data), end_(end) {}
+
+    inline const uint8_t* data() const { return this->data_; }
+    inline const uint8_t* end() const { return this->end_; }
+    inline bool empty() const { return this->data_ == this->end_; }
+
+   private:
+    const uint8_t* data_;
+    const uint8_t* end_;
+};
+
+/*!
+ * @brief An immutable list of the token positions of every term in every document it appears in, which accompanies the PostingIndex of the same field.
+ * @details Position list i describes the documents of posting list i of the PostingIndex, in the same increasing document ID order. For every document, it stores the byte size of the document's entry, followed by the gap to the previous position (the first position is stored as is) of every occurrence of the term, all as LEB128 variable-byte integers. The byte size lets a reader skip the documents it does not need without decoding their positions, and the amount of positions of a document is the term frequency of its posting.
+ * @tparam T The unsigned integer type used for the document IDs.
+ */
+template <typename T>
+class PositionIndex {
+   public:
+    /*!
+     * @brief Builds ordinal_count position lists from the positions collected by every parsing thread, where the positions of term ID t go to list term_ordinals[t].
+     * @details The runs are bucketed by list and then sorted by document ID within each list, so building costs O(n) plus the sort of each list's documents, and only copies the encoded bytes.
+     */
+    void Build(const std::vector<PositionRuns<T>>& runs_vec, const std::vector<uint32_t>& term_ordinals, size_t ordinal_count) {
+        this->Clear();
+        struct SortedRun {
+            T document_id;
+            uint32_t runs_subscript;
+            size_t byte_offset;
+        };
+        std::vector<size_t> ordinal_starts(ordinal_count + 1, 0);
+        size_t byte_count = 0;
+        for (auto&& runs : runs_vec) {
+            for (auto&& run : runs.runs()) {
+                ordinal_starts[term_ordinals[run.term_id] + 1]++;
+            }
+            byte_count += runs.byte_size();
+        }
+        for (size_t ordinal = 0; ordinal < ordinal_count; ordinal++) {
+            ordinal_starts[ordinal + 1] += ordinal_starts[ordinal];
+        }
+        std::vector<SortedRun> sorted_runs(ordinal_starts.back());
+        std::vector<size_t> ordinal_cursors(ordinal_starts.begin(), ordinal_starts.end() - 1);
+        for (size_t i = 0; i < runs_vec.size(); i++) {
+            for (auto&& run : runs_vec[i].runs()) {
+                sorted_runs[ordinal_cursors[term_ordinals[run.term_id]]++] = SortedRun{.document_id = run.document_id, .runs_subscript = (uint32_t)i, .byte_offset = run.byte_offset};
+            }
+        }
+
+        this->bytes_.reserve(byte_count);
+        this->offsets_.reserve(ordinal_count + 1);
+        for (size_t ordinal = 0; ordinal < ordinal_count; ordinal++) {
+            std::sort(sorted_runs.begin() + ordinal_starts[ordinal], sorted_runs.begin() + ordinal_starts[ordinal + 1], [](const SortedRun& a, const SortedRun& b) { return a.document_id < b.document_id; });
+            for (size_t i = ordinal_starts[ordinal]; i < ordinal_starts[ordinal + 1]; i++) {
+                const uint8_t* const entry = runs_vec[sorted_runs[i].runs_subscript].bytes() + sorted_runs[i].byte_offset;
+                const uint8_t* cursor = entry;
+                const size_t entry_byte_count = PostingList<T>::ReadVarint(cursor);
+                this->bytes_.insert(this->bytes_.end(), entry, cursor + entry_byte_count);
+            }
+            this->offsets_.push_back(this->bytes_.size());
+        }
+    }
+
+    /*!
+     * @brief Copies the given, already encoded, entries in as the position list of the next ordinal.
+     */
+    void AppendEncoded(const uint8_t* entries, size_t byte_count) {
+        this->bytes_.insert(this->bytes_.end(), entries, entries + byte_count);
+        this->offsets_.push_back(this->bytes_.size());
+    }
+
+    /*!
+     * @warning The returned view is invalidated by any call to Build, AppendEncoded or Clear.
+     */
+    inline PositionList operator[](size_t term_id) const { return PositionList(this->bytes_.data() + this->offsets_[term_id], this->bytes_.data() + this->offsets_[term_id + 1]); }
+
+    // The amount of position lists in the index, which is 0 if no positions were recorded.
+    inline size_t size() const { return this->offsets_.size() - 1; }
+    inline bool empty() const { return this->offsets_.size() == 1; }
+
+    // The amount of heap memory held by the index.
+    inline size_t byte_count() const { return this->bytes_.capacity() + this->offsets_.capacity() * sizeof(size_t); }
+
+    inline void Clear() {
+        this->bytes_ = MappableArray<uint8_t>();
+        this->offsets_.assign(1, 0);
+    }
+
+    /*!
+     * @brief Writes the index to the given index file.
+     */
+    void Write(IndexFileWriter& writer) const {
+        writer.WriteArray(this->bytes_);
+        writer.WriteArray(this->offsets_);
+    }
+
+    /*!
+     * @brief Makes the index a read-only view of the index that Write wrote next in the given file, which must stay mapped for as long as the index is read.
+     * @return Whether the file held a well-formed index, whose position lists all lie within its bytes and end on the last byte of a varint. If not, the index is left empty.
+     */
+    bool Map(IndexFileReader& reader) {
+        auto ends_on_varint = [this](size_t, size_t end) { return (this->bytes_[end - 1] & 0x80) == 0; };
+        if (reader.ReadArray(this->bytes_) == false || reader.ReadArray(this->offsets_) == false || AreValidOffsets(this->offsets_, this->bytes_.size(), ends_on_varint) == false) {
+            this->Clear();
+            return false;
+        }
+        return true;
+    }
+
+   private:
+    MappableArray<uint8_t> bytes_;
+    MappableArray<size_t> offsets_ = {0};  // term ID -> offset of its position list in bytes_, followed by the end of bytes_
+};
+
+/*!
+ * @brief Walks a posting list and its position list together, in increasing document ID order.
+ */
+template <typename T>
+class PositionCursor {
+   public:
+    PositionCursor(const PostingList<T>& postings, const PositionList& positions) : posting_(postings.begin()), posting_end_(postings.end()), entry_(positions.data()) {}
+
+    /*!
+     * @brief Moves to the first document whose ID is at least target, skipping the positions of every document it passes without decoding them.
+     * @return Whether the list holds such a document.
+     */
+    inline bool NextGeq(T target) {
+        while (this->posting_ != this->posting_end_ && this->posting_->first < target) {
+            const size_t entry_byte_count = PostingList<T>::ReadVarint(this->entry_);
+            this->entry_ += entry_byte_count;
+            ++this->posting_;
+        }
+        return this->posting_ != this->posting_end_;
+    }
+
+    inline T document_id() const { return this->posting_->first; }
+
+    /*!
+     * @brief Decodes the positions of the current document into positions, in increasing order.
+     */
+    void Positions(std::vector<uint32_t>& positions) const {
+        positions.clear();
+        const uint8_t* cursor = this->entry_;
+        const size_t entry_byte_count = PostingList<T>::ReadVarint(cursor);
+        const uint8_t* const end = cursor + entry_byte_count;
+        uint32_t position = 0;
+        while (cursor != end) {
+            position += PostingList<T>::ReadVarint(cursor);
+            positions.push_back(position);
+        }
+    }
+
+   private:
+    typename PostingList<T>::Iterator posting_;
+    typename PostingList<T>::Iterator posting_end_;
+    const uint8_t* entry_;  // the entry of the current document in the position list
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_POSITIONINDEX_H_
\ No newline at end of file
@@ -0,0 +1,239 @@
+#ifndef SEARCH_ENGINE_PROJECT_POSTINGLIST_H_
+#define SEARCH_ENGINE_PROJECT_POSTINGLIST_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "IndexFile.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief A read-only view of one compressed posting list, which is a run of {document ID, term frequency} pairs sorted by document ID.
+ * @details A list is stored as its document frequency, followed by the gap to the previous document ID (the first document ID is stored as is) and the term frequency of every pair, all as LEB128 variable-byte integers. An empty list takes no bytes at all.
+ * @tparam T The unsigned integer type used for the document IDs.
+ */
+template <typename T>
+class PostingList {
+   public:
+    /*!
+     * @brief Decodes the pairs of a PostingList one at a time, in increasing document ID order.
+     */
+    class Iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<T, uint32_t>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        Iterator(const uint8_t* cursor, const uint8_t* end) : cursor_(cursor), end_(end), posting_(0, 0) {
+            this->Decode();
+        }
+
+        // first is the document ID and second is the term frequency.
+        inline reference operator*() const { return this->posting_; }
+        inline pointer operator->() const { return &this->posting_; }
+
+        inline Iterator& operator++() {
+            this->cursor_ = this->next_;
+            this->Decode();
+            return *this;
+        }
+
+        inline bool operator==(const Iterator& other) const { return this->cursor_ == other.cursor_; }
+        inline bool operator!=(const Iterator& other) const { return this->cursor_ != other.cursor_; }
+
+       private:
+        inline void Decode() {
+            if (this->cursor_ == this->end_) {
+                return;
+            }
+            this->next_ = this->cursor_;
+            this->posting_.first += ReadVarint(this->next_);
+            this->posting_.second = ReadVarint(this->next_);
+        }
+
+        const uint8_t* cursor_;  // the first byte of the current pair
+        const uint8_t* next_;    // the first byte of the pair after the current one
+        const uint8_t* end_;
+        value_type posting_;
+    };
+
+    PostingList() : data_(nullptr), end_(nullptr) {}
+    PostingList(const uint8_t* data, const uint8_t* end) : data_(data), end_(end) {}
+
+    /*!
+     * @brief Returns the amount of documents in the list.
+     */
+    inline size_t size() const {
+        if (this->data_ == this->end_) {
+            return 0;
+        }
+        const uint8_t* cursor = this->data_;
+        return ReadVarint(cursor);
+    }
+
+    inline bool empty() const { return this->data_ == this->end_; }
+
+    // The encoded bytes of the list.
+    inline const uint8_t* data() const { return this->data_; }
+    inline size_t byte_size() const { return this->end_ - this->data_; }
+
+    inline Iterator begin() const {
+        if (this->data_ == this->end_) {
+            return Iterator(this->end_, this->end_);
+        }
+        const uint8_t* cursor = this->data_;
+        ReadVarint(cursor);
+        return Iterator(cursor, this->end_);
+    }
+
+    inline Iterator end() const { return Iterator(this->end_, this->end_); }
+
+    // Two lists are equal if they hold the same pairs, since a list only has one encoding.
+    inline bool operator==(const PostingList& other) const { return std::equal(this->data_, this->end_, other.data_, other.end_); }
+    inline bool operator!=(const PostingList& other) const { return !(*this == other); }
+
+    // Appends the given value to any container of bytes with a push_back, such as a std::vector<uint8_t> or a MappableArray<uint8_t>.
+    template <typename Bytes>
+    static inline void WriteVarint(Bytes& bytes, uint64_t value) {
+        while (value >= 0x80) {
+            bytes.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+
+    static inline uint64_t ReadVarint(const uint8_t*& cursor) {
+        uint64_t value = *cursor & 0x7f;
+        for (unsigned shift = 7; (*cursor++ & 0x80) != 0; shift += 7) {
+            value |= static_cast<uint64_t>(*cursor & 0x7f) << shift;
+        }
+        return value;
+    }
+
+   private:
+    const uint8_t* data_;
+    const uint8_t* end_;
+};
+
+/*!
+ * @brief An immutable list of compressed posting lists, one per term ID, stored back to back in a single byte buffer.
+ * @details Posting lists are appended in term ID order while the index is built, and are read through PostingList views afterwards. Each term costs one offset on top of the bytes of its list.
+ * @tparam T The unsigned integer type used for the document IDs.
+ */
+template <typename T>
+class PostingIndex {
+   public:
+    /*!
+     * @brief Encodes the given postings as the posting list of the next term ID.
+     * @param postings Any range of {document ID, term frequency} pairs, in any order, with no document ID appearing twice.
+     */
+    template <typename Postings>
+    void Append(const Postings& postings) {
+        if (postings.size() > 0) {
+            this->scratch_.assign(postings.begin(), postings.end());
+            std::sort(this->scratch_.begin(), this->scratch_.end());
+            PostingList<T>::WriteVarint(this->bytes_, this->scratch_.size());
+            T previous_document_id = 0;
+            for (auto&& posting : this->scratch_) {
+                PostingList<T>::WriteVarint(this->bytes_, posting.first - previous_document_id);
+                PostingList<T>::WriteVarint(this->bytes_, posting.second);
+                previous_document_id = posting.first;
+            }
+            this->posting_count_ += this->scratch_.size();
+        }
+        this->offsets_.push_back(this->bytes_.size());
+    }
+
+    /*!
+     * @brief Copies the given, already encoded, posting list in as the posting list of the next term ID.
+     */
+    void AppendEncoded(const PostingList<T>& posting_list) {
+        this->bytes_.insert(this->bytes_.end(), posting_list.data(), posting_list.data() + posting_list.byte_size());
+        this->offsets_.push_back(this->bytes_.size());
+        this->posting_count_ += posting_list.size();
+    }
+
+    /*!
+     * @brief Reserves room for the given amount of posting lists and encoded bytes.
+     */
+    void Reserve(size_t list_count, size_t byte_count) {
+        this->offsets_.reserve(this->offsets_.size() + list_count);
+        this->bytes_.reserve(this->bytes_.size() + byte_count);
+    }
+
+    // The amount of encoded bytes in the index.
+    inline size_t encoded_byte_count() const { return this->bytes_.size(); }
+
+    /*!
+     * @brief Releases the spare capacity left over from building the index.
+     */
+    void ShrinkToFit() {
+        this->bytes_.shrink_to_fit();
+        this->offsets_.shrink_to_fit();
+        this->scratch_ = std::vector<std::pair<T, uint32_t>>();
+    }
+
+    /*!
+     * @warning The returned view is invalidated by any call to Append or Clear.
+     */
+    inline PostingList<T> operator[](size_t term_id) const { return PostingList<T>(this->bytes_.data() + this->offsets_[term_id], this->bytes_.data() + this->offsets_[term_id + 1]); }
+
+    // The amount of posting lists in the index, which is one more than the largest term ID that was appended.
+    inline size_t size() const { return this->offsets_.size() - 1; }
+
+    // The total amount of pairs in every posting list of the index.
+    inline size_t posting_count() const { return this->posting_count_; }
+
+    // The amount of heap memory held by the index.
+    inline size_t byte_count() const { return this->bytes_.capacity() + this->offsets_.capacity() * sizeof(size_t) + this->scratch_.capacity() * sizeof(std::pair<T, uint32_t>); }
+
+    inline void Clear() {
+        this->bytes_.clear();
+        this->offsets_.assign(1, 0);
+        this->posting_count_ = 0;
+    }
+
+    /*!
+     * @brief Writes the index to the given index file.
+     */
+    void Write(IndexFileWriter& writer) const {
+        writer.WriteValue(this->posting_count_);
+        writer.WriteArray(this->bytes_);
+        writer.WriteArray(this->offsets_);
+    }
+
+    /*!
+     * @brief Makes the index a read-only view of the index that Write wrote next in the given file, which must stay mapped for as long as the index is read.
+     * @return Whether the file held a well-formed index, whose posting lists all lie within its bytes and end on the last byte of a varint, so that no varint read from a list runs past its end. If not, the index is left empty.
+     */
+    bool Map(IndexFileReader& reader) {
+        uint64_t posting_count;
+        auto ends_on_varint = [this](size_t, size_t end) { return (this->bytes_[end - 1] & 0x80) == 0; };
+        if (reader.ReadValue(posting_count) == false || reader.ReadArray(this->bytes_) == false || reader.ReadArray(this->offsets_) == false || AreValidOffsets(this->offsets_, this->bytes_.size(), ends_on_varint) == false) {
+            this->Clear();
+            return false;
+        }
+        this->posting_count_ = posting_count;
+        return true;
+    }
+
+   private:
+    MappableArray<uint8_t> bytes_;
+    MappableArray<size_t> offsets_ = {0};  // term ID -> offset of its posting list in bytes_, followed by the end of bytes_
+    size_t posting_count_ = 0;
+    std::vector<std::pair<T, uint32_t>> scratch_;  // reused by Append to sort the postings of a term
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_POSTINGLIST_H_
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "QueryParser.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+struct CategoryName {
+    std::string_view name;
+    search_engine::QueryCategory category;
+};
+
+constexpr CategoryName kCategoryNames[] = {
+    {"values", search_engine::QueryCategory::kValues},
+    {"title", search_engine::QueryCategory::kTitle},
+    {"sites", search_engine::QueryCategory::kSites},
+    {"langs", search_engine::QueryCategory::kLangs},
+    {"locations", search_engine::QueryCategory::kLocations},
+    {"people", search_engine::QueryCategory::kPeople},
+    {"orgs", search_engine::QueryCategory::kOrgs},
+    {"authors", search_engine::QueryCategory::kAuthors},
+    {"countries", search_engine::QueryCategory::kCountries},
+};
+
+// Larger slops are clamped, since no phrase can span more words than a document holds.
+constexpr uint32_t kMaxSlop = 1 << 20;
+
+}  // namespace
+
+search_engine::Query search_engine::QueryParser::Parse(std::string_view query) {
+    Query parsed_query;
+    size_t part_start = 0;
+    while (part_start <= query.size()) {
+        size_t part_end = query.find('|', part_start);
+        if (part_end == std::string_view::npos) {
+            part_end = query.size();
+        }
+        const std::string_view part = query.substr(part_start, part_end - part_start);
+        part_start = part_end + 1;
+
+        // A clause starts at the first category name of the part that is followed by a ':', wherever it is.
+        for (size_t i = 0; i < part.size(); i++) {
+            const CategoryName* category_name = nullptr;
+            for (auto&& candidate : kCategoryNames) {
+                if (part.compare(i, candidate.name.size(), candidate.name) == 0 && i + candidate.name.size() < part.size() && part[i + candidate.name.size()] == ':') {
+                    category_name = &candidate;
+                    break;
+                }
+            }
+            if (category_name == nullptr) {
+                continue;
+            }
+            QueryClause clause = {.category = category_name->category, .terms = {}};
+            ParseTerms(part.substr(i + category_name->name.size() + 1), clause, parsed_query);
+            parsed_query.clauses.push_back(std::move(clause));
+            break;
+        }
+    }
+    return parsed_query;
+}
+
+void search_engine::QueryParser::ParseTerms(std::string_view text, QueryClause& clause, Query& query) {
+    size_t i = 0;
+    // The occurrence that an AND or NOT operator gives to the next term of the clause.
+    QueryOccurrence pending_occurrence = QueryOccurrence::kShould;
+    while (i < text.size()) {
+        if (text[i] == ' ' || text[i] == ',') {
+            i++;
+            continue;
+        }
+
+        const size_t argument_start = i;
+        QueryOccurrence occurrence = pending_occurrence;
+        if ((text[i] == '+' || text[i] == '-') && i + 1 < text.size() && text[i + 1] != ' ' && text[i + 1] != ',') {
+            occurrence = text[i] == '+' ? QueryOccurrence::kMust : QueryOccurrence::kMustNot;
+            i++;
+        }
+
+        // A quoted argument ends at its first unescaped quote. If it has none, it ends at its last escaped quote, which makes its quotes mismatched, and if it has neither it is read like an unquoted argument.
+        size_t end = std::string_view::npos;
+        if (text[i] == '\"') {
+            size_t last_escaped_quote = std::string_view::npos;
+            size_t j = i + 1;
+            for (; j < text.size(); j++) {
+                if (text[j] == '\\' && j + 1 < text.size() && text[j + 1] == '\"') {
+                    last_escaped_quote = ++j;
+                } else if (text[j] == '\"') {
+                    break;
+                }
+            }
+            if (j < text.size() && j > i + 1) {
+                end = j + 1;
+            } else if (j == text.size() && last_escaped_quote != std::string_view::npos) {
+                end = last_escaped_quote + 1;
+            }
+        }
+        if (end == std::string_view::npos) {
+            end = std::min(text.find_first_of(" ,", i), text.size());
+        }
+        const std::string_view argument = text.substr(i, end - i);
+        i = end;
+        uint32_t slop = 0;
+        if (argument.size() > 2 && argument.front() == '\"' && argument.back() == '\"' && i + 1 < text.size() && text[i] == '~' && std::isdigit((unsigned char)text[i + 1]) != 0) {
+            for (i++; i < text.size() && std::isdigit((unsigned char)text[i]) != 0; i++) {
+                slop = std::min<uint32_t>(slop * 10 + (text[i] - '0'), kMaxSlop);
+            }
+        }
+        const std::string_view raw_argument = text.substr(argument_start, i - argument_start);
+
+        if (raw_argument.size() == argument.size()) {
+            if (argument == "AND") {
+                if (clause.terms.empty() == false && clause.terms.back().occurrence == QueryOccurrence::kShould) {
+                    clause.terms.back().occurrence = QueryOccurrence::kMust;
+                }
+                pending_occurrence = QueryOccurrence::kMust;
+                continue;
+            }
+            if (argument == "NOT") {
+                pending_occurrence = QueryOccurrence::kMustNot;
+                continue;
+            }
+            if (argument == "OR") {
+                pending_occurrence = QueryOccurrence::kShould;
+                continue;
+            }
+        }
+        pending_occurrence = QueryOccurrence::kShould;
+
+        if (argument.size() <= 2) {
+            query.warnings.push_back("Invalid term size. The following term was skipped: " + std::string(raw_argument));
+            continue;
+        }
+
+        const bool has_front_quote = argument.front() == '\"';
+        const bool has_back_quote = argument.back() == '\"';
+        const bool back_quote_esc = has_back_quote == true && argument[argument.size() - 2] == '\\';
+        if ((has_front_quote == true && (has_back_quote == false || back_quote_esc == true)) || (has_front_quote == false && (has_back_quote == true && back_quote_esc == false))) {
+            query.warnings.push_back("Invalid quote matching. The following term was skipped: " + std::string(raw_argument));
+            continue;
+        }
+
+        if (has_front_quote == false) {
+            clause.terms.push_back(QueryTerm{.text = std::string(argument), .is_phrase = false, .occurrence = occurrence, .slop = 0});
+            continue;
+        }
+        QueryTerm term = {.text = {}, .is_phrase = true, .occurrence = occurrence, .slop = slop};
+        term.text.reserve(argument.size() - 2);
+        for (size_t j = 1; j + 1 < argument.size(); j++) {
+            if (argument[j] == '\\' && argument[j + 1] == '\"' && j + 2 < argument.size()) {
+                j++;
+            }
+            term.text.push_back(argument[j]);
+        }
+        // Such words are never indexed, which would otherwise silently change what the phrase matches.
+        const bool has_non_ascii = std::any_of(term.text.begin(), term.text.end(), [](char c) { return (unsigned char)c > 127; });
+        if ((clause.category == QueryCategory::kValues || clause.category == QueryCategory::kTitle) && has_non_ascii == true) {
+            query.warnings.push_back("Words with non-ASCII characters cannot be searched for. Any word matches in their place within the following phrase, and they are left off its ends: " + std::string(raw_argument));
+        }
+        clause.terms.push_back(std::move(term));
+    }
+}
\ No newline at end of file
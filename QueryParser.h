@@ -0,0 +1,78 @@
+#ifndef SEARCH_ENGINE_PROJECT_QUERYPARSER_H_
+#define SEARCH_ENGINE_PROJECT_QUERYPARSER_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace search_engine {
+
+/*!
+ * @brief The categories a query clause can search, in the order they are listed in the README.
+ */
+enum class QueryCategory : uint8_t {
+    kValues,
+    kTitle,
+    kSites,
+    kLangs,
+    kLocations,
+    kPeople,
+    kOrgs,
+    kAuthors,
+    kCountries,
+};
+
+/*!
+ * @brief Whether the documents that match a query must, may, or must not hold a term.
+ */
+enum class QueryOccurrence : uint8_t {
+    kShould,   // a document must hold at least one kShould term of the query if the query has no kMust term, and otherwise kShould terms only affect the ranking
+    kMust,     // a document must hold the term, which is marked with a '+' prefix or joined to a neighbouring term with AND
+    kMustNot,  // a document must not hold the term, which is marked with a '-' prefix or preceded by NOT
+};
+
+/*!
+ * @brief One argument of a query clause.
+ */
+struct QueryTerm {
+    std::string text;  // without its prefix and surrounding quotes, and with every escaped quote unescaped
+    bool is_phrase;    // whether the argument was wrapped in quotes
+    QueryOccurrence occurrence;
+    uint32_t slop;  // the most other words that may appear inside a phrase, given as a ~N suffix after its closing quote, and 0 otherwise
+};
+
+/*!
+ * @brief A category, such as `values:`, followed by the arguments it is searched for.
+ */
+struct QueryClause {
+    QueryCategory category;
+    std::vector<QueryTerm> terms;
+};
+
+/*!
+ * @brief The syntax tree of a query, which is a list of clauses separated by '|' characters.
+ */
+struct Query {
+    std::vector<QueryClause> clauses;
+    std::vector<std::string> warnings;  // one message per argument that was skipped or cannot be searched for as written, in the order they appear in the query
+};
+
+/*!
+ * @brief A single-pass, hand-written parser for the query language described in the README.
+ * @details A query is split on '|' characters. The text of each part that comes before its first category name followed by a ':' is ignored, as is a part without one. The arguments of a clause are separated by commas and/or spaces, and an argument wrapped in double quotes may contain commas, spaces and escaped (\") quotes. An argument of two characters or less, or whose quotes do not match, is skipped with a warning.
+ * A quoted argument may be followed by '~' and a number, which lets that many other words appear inside the phrase.
+ * An argument prefixed with '+' is required and one prefixed with '-' is excluded. The unquoted, upper-case arguments AND, OR and NOT are operators within their clause: AND requires the terms on both of its sides, NOT excludes the term after it, and OR leaves its neighbours as they are, since terms are alternatives by default.
+ */
+class QueryParser {
+   public:
+    static Query Parse(std::string_view query);
+
+   private:
+    // Appends the arguments found in the given text, which is everything after the ':' of a clause, to clause, and the warnings about skipped arguments, and about phrases with words that cannot be searched for, to query.
+    static void ParseTerms(std::string_view text, QueryClause& clause, Query& query);
+};
+
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_QUERYPARSER_H_
\ No newline at end of file
@@ -2,27 +2,48 @@
 #define SEARCH_ENGINE_PROJECT_SEARCHENGINE_H_
 
 #include <algorithm>
+#include <deque>
+#include <iostream>
 #include <memory>
 #include <optional>
-#include <regex>
+#include <sstream>
 
+#include "Intersection.h"
+#include "QueryParser.h"
 #include "SourceEngine.h"
 
 namespace search_engine {
 
-template <typename T, typename U, typename V = U>
+template <typename T, typename U, typename V = U, typename ContainerPolicy = source_util::StdContainerPolicy>
 class SearchEngine {
    public:
-    SearchEngine(std::unique_ptr<source_util::SourceEngine<T, U, V>>&& dep_inj_ptr) : source_engine_ptr_{std::forward<std::unique_ptr<source_util::SourceEngine<T, U, V>>>(dep_inj_ptr)} {}
+    /*!
+     * @brief How the documents that match a query are ordered.
+     */
+    enum class RankingMode {
+        kCascade,  // by the metadata flags, then by the raw title, meta-data and value counts
+        kBm25,     // by the metadata flags, then by the BM25 score of the values and title terms
+    };
+
+    SearchEngine(std::unique_ptr<source_util::SourceEngine<T, U, V, ContainerPolicy>>&& dep_inj_ptr, RankingMode ranking_mode = RankingMode::kCascade) : source_engine_ptr_{std::forward<std::unique_ptr<source_util::SourceEngine<T, U, V, ContainerPolicy>>>(dep_inj_ptr)}, ranking_mode_(ranking_mode) {}
 
     void InitCommandLineInterface(std::optional<std::string> shortcut = std::nullopt);
 
     /*!
-     * @brief Handles a query and returns a vector containing a set of the filepaths of the sources that match the query.
+     * @brief Handles a query and returns a vector containing a set of the filepaths of the sources that match the query. Every argument of the query that is skipped is reported on the console.
+     * @param query The query to be handled, in the format described in the README.
+     * @param result_count The amount of best ranked sources to return. This parameter is optional, and defaults to std::nullopt, which returns every source that matches the query.
+     * @return A vector containing a set of the filepaths of the sources that match the query, best ranked first.
+     */
+    std::vector<std::string> HandleQuery(std::string query, std::optional<size_t> result_count = std::nullopt);
+
+    /*!
+     * @brief Handles a query that has already been parsed by QueryParser, which lets a caller parse a query once and run it many times.
      * @param query The query to be handled.
-     * @return A vector containing a set of the filepaths of the sources that match the query.
+     * @param result_count The amount of best ranked sources to return. This parameter is optional, and defaults to std::nullopt, which returns every source that matches the query.
+     * @return A vector containing a set of the filepaths of the sources that match the query, best ranked first.
      */
-    std::vector<std::string> HandleQuery(std::string query);
+    std::vector<std::string> HandleQuery(const Query& query, std::optional<size_t> result_count = std::nullopt);
 
    private:
     struct AppraisedArticle {
@@ -35,19 +56,60 @@ class SearchEngine {
         bool language_flag;
         bool location_flag;
         bool country_flag;
+        double bm25_score;  // only accumulated in RankingMode::kBm25
+    };
+    // A matching document and its appraisal, copied out of the results map of a query so that ranking never looks a document up.
+    struct RankedArticle {
+        T document_id;
+        AppraisedArticle appraisal;
+    };
+
+    using Segment = typename source_util::RunTimeDatabase<T, U, V, ContainerPolicy>::Segment;
+    using TermDocuments = source_util::TermDocuments<T, typename ContainerPolicy::template DocumentSet<T>>;
+    using Results = typename ContainerPolicy::template HashMap<T, AppraisedArticle>;
+
+    // A term of a query, cleaned once so that it can be looked up in every segment.
+    struct CleanedTerm {
+        QueryCategory category;
+        QueryOccurrence occurrence;
+        const QueryTerm* term;
+        std::vector<U> term_ids;  // the words of a values or title term, which has no documents if it is empty or holds source_util::TermDictionary::kNoTerm, and where source_util::TermDictionary::kAnyTerm is a word of a phrase that any word matches
+        V metadata;               // the cleaned value of a meta-data term
+    };
+
+    // The documents that hold a phrase, encoded like the posting list of a single term so that a phrase is ranked and intersected like any other term.
+    struct PhraseMatches {
+        source_util::PostingIndex<T> postings;  // a single list of {document ID, phrase frequency} pairs
+        source_util::BlockMaxIndex<T> block_maxes;
     };
 
-    std::unique_ptr<source_util::SourceEngine<T, U, V>> source_engine_ptr_;
+    // Cleans the given term of a clause of the given category the way its category was cleaned when it was indexed.
+    CleanedTerm CleanTerm(QueryCategory category, const QueryTerm& term);
+
+    // Looks up the documents of the given segment that hold the given term. A term that was never indexed has no documents. A values or title phrase of more than one word is matched by MatchPhrase into a new element of phrase_matches, which must outlive the returned documents.
+    TermDocuments FindTermDocuments(const Segment& segment, const CleanedTerm& term, std::deque<PhraseMatches>& phrase_matches);
+
+    // Adds the documents of one segment that match the query to results, given the documents of the segment that hold each cleaned term, and the amount of documents of the whole database that hold each term.
+    void EvaluateSegment(const std::vector<CleanedTerm>& cleaned_terms, const std::vector<TermDocuments>& term_documents, const std::vector<size_t>& document_frequencies, std::optional<size_t> result_count, Results& results);
+
+    // Returns whether a ranks strictly before b. Every document ID appears at most once, so this is a strict total order.
+    static bool RanksBefore(const RankedArticle& a, const RankedArticle& b, bool rank_by_bm25);
+
+    // The amount of results the command line interface lists for a query.
+    static constexpr size_t kDisplayedResultCount = 10;
+
+    std::unique_ptr<source_util::SourceEngine<T, U, V, ContainerPolicy>> source_engine_ptr_;
+    RankingMode ranking_mode_;
 };
 
-template <typename T, typename U, typename V>
-void SearchEngine<T, U, V>::InitCommandLineInterface(std::optional<std::string> shortcut) {
+template <typename T, typename U, typename V, typename ContainerPolicy>
+void SearchEngine<T, U, V, ContainerPolicy>::InitCommandLineInterface(std::optional<std::string> shortcut) {
     std::string input;
     if (shortcut.has_value()) {
         input = shortcut.value();
     } else {
         std::cout << "Welcome to the search engine!" << std::endl;
-        std::cout << "Please type 'query' to enter a query, type 'parse' to parse data sources, or type 'exit' to quit." << std::endl;
+        std::cout << "Please type 'query' to enter a query, type 'parse' to parse data sources, type 'update' to add new and changed data sources to the parsed ones, or type 'exit' to quit." << std::endl;
         std::cout << ">> ";
         std::getline(std::cin, input);
     }
@@ -56,14 +118,11 @@ void SearchEngine<T, U, V>::InitCommandLineInterface(std::optional<std::string>
         while (input == "query") {
             std::cout << "Please enter your query: ";
             std::getline(std::cin, input);
-            std::vector<std::string> results = std::move(this->HandleQuery(input));
+            std::vector<std::string> results = std::move(this->HandleQuery(input, kDisplayedResultCount));
             while (true) {
                 size_t result_index = 0;
                 std::cout << "Results: for " << input << std::endl;
                 for (auto&& result : results) {
-                    if (result_index == 10) {
-                        break;
-                    }
                     std::cout << result_index++ << "\t";
                     this->source_engine_ptr_->DisplaySource(result, true);
                 }
@@ -89,296 +148,393 @@ void SearchEngine<T, U, V>::InitCommandLineInterface(std::optional<std::string>
             std::cout << "Please enter the path to the data you would like to parse: ";
             std::getline(std::cin, input);
             this->source_engine_ptr_->ParseSources(input);
+        } else if (input == "update") {
+            // Only the sources that were added or changed since they were parsed are parsed again, and the ones that were removed are deleted.
+            std::cout << "Please enter the path to the data you would like to update: ";
+            std::getline(std::cin, input);
+            this->source_engine_ptr_->ParseSources(input);
         } else if (input != "main") {
             std::cout << "Invalid input. Please try again." << std::endl;
         }
 
-        std::cout << "Please type 'query' to enter a query, type 'parse' to parse data sources, or type 'exit' to quit." << std::endl;
+        std::cout << "Please type 'query' to enter a query, type 'parse' to parse data sources, type 'update' to add new and changed data sources to the parsed ones, or type 'exit' to quit." << std::endl;
         std::cout << ">> ";
         std::getline(std::cin, input);
     }
 }
 
-template <typename T, typename U, typename V>
-std::vector<std::string> SearchEngine<T, U, V>::HandleQuery(std::string query) {
-    std::unordered_map<std::string, AppraisedArticle> results;
+template <typename T, typename U, typename V, typename ContainerPolicy>
+std::vector<std::string> SearchEngine<T, U, V, ContainerPolicy>::HandleQuery(std::string query, std::optional<size_t> result_count) {
+    const Query parsed_query = QueryParser::Parse(query);
+    for (auto&& warning : parsed_query.warnings) {
+        std::cout << warning << std::endl;
+    }
+    return this->HandleQuery(parsed_query, result_count);
+}
 
-    std::regex category_pattern(R"(((?:(?:values)|(?:title)|(?:sites)|(?:langs)|(?:locations)|(?:people)|(?:orgs)|(?:authors)|(?:countries)):[^|]*))");
-    for (std::regex_iterator<std::string::iterator> it(query.begin(), query.end(), category_pattern); it != std::regex_iterator<std::string::iterator>(); ++it) {
-        std::string category_match = std::move(it->str());
-        int64_t category_hash = category_match[0] + (category_match[1] * 2);
-        std::regex arg_pattern("\"((?:\\\\\"|[^\"])+)\"|([^, ]+)");  // states that the user must seperate the arguments with a comma and/or a space, and that the arguments can't contain a comma, space, or curly brace.
-                                                                     // stats that the user can enter in a string with commas and/or spaces in it by surrounding the string with double quotes.
+template <typename T, typename U, typename V, typename ContainerPolicy>
+typename SearchEngine<T, U, V, ContainerPolicy>::CleanedTerm SearchEngine<T, U, V, ContainerPolicy>::CleanTerm(QueryCategory category, const QueryTerm& term) {
+    CleanedTerm cleaned_term = {.category = category, .occurrence = term.occurrence, .term = &term, .term_ids = {}, .metadata = {}};
+    if (category == QueryCategory::kValues || category == QueryCategory::kTitle) {
+        if (term.is_phrase == true) {
+            cleaned_term.term_ids = std::move(this->source_engine_ptr_->CleanPhrase(term.text.c_str(), term.text.size()));
+        } else {
+            cleaned_term.term_ids.push_back(this->source_engine_ptr_->CleanValue(term.text.c_str(), term.text.size()));
+        }
+    } else {
+        cleaned_term.metadata = std::move(this->source_engine_ptr_->CleanMetaData(term.text.c_str(), term.text.size()));
+    }
+    return cleaned_term;
+}
 
-        for (std::regex_iterator<std::string::iterator> it2(category_match.begin(), category_match.end(), arg_pattern); it2 != std::regex_iterator<std::string::iterator>(); ++it2) {
-            std::string arg_match = std::move(it2->str());
+template <typename T, typename U, typename V, typename ContainerPolicy>
+typename SearchEngine<T, U, V, ContainerPolicy>::TermDocuments SearchEngine<T, U, V, ContainerPolicy>::FindTermDocuments(const Segment& segment, const CleanedTerm& term, std::deque<PhraseMatches>& phrase_matches) {
+    const auto* const runtime_database = this->source_engine_ptr_->GetRuntimeDatabase();
+    TermDocuments term_documents = {.postings = {}, .block_max_index = nullptr, .ordinal = 0, .documents = nullptr};
+    const typename Segment::MetadataIndex* metadata_index = nullptr;
+    switch (term.category) {
+        case QueryCategory::kValues:
+        case QueryCategory::kTitle: {
+            const bool is_title = term.category == QueryCategory::kTitle;
+            const source_util::PostingIndex<T>& posting_index = is_title == true ? segment.title_postings : segment.value_postings;
+            const source_util::BlockMaxIndex<T>& block_max_index = is_title == true ? segment.title_block_maxes : segment.value_block_maxes;
+            if (term.term_ids.empty() == true) {
+                return term_documents;
+            }
+            std::vector<size_t> ordinals;
+            std::vector<uint32_t> offsets;  // the place of every word of ordinals in the phrase, which skips the words any word matches
+            for (size_t i = 0; i < term.term_ids.size(); i++) {
+                const U term_id = term.term_ids[i];
+                if (term_id == source_util::TermDictionary::kAnyTerm) {
+                    continue;
+                }
+                const size_t ordinal = term_id == source_util::TermDictionary::kNoTerm ? Segment::kNoOrdinal : segment.Ordinal(term_id);
+                if (ordinal == Segment::kNoOrdinal) {
+                    return term_documents;
+                }
+                ordinals.push_back(ordinal);
+                offsets.push_back(i);
+            }
+            if (ordinals.size() == 1) {
+                term_documents.postings = posting_index[ordinals.front()];
+                term_documents.block_max_index = &block_max_index;
+                term_documents.ordinal = ordinals.front();
+                return term_documents;
+            }
 
-            if (arg_match.size() <= 2) {
-                std::cout << "Invalid term size. The following term was skipped: " << arg_match << std::endl;
-                continue;
+            const source_util::PositionIndex<T>& position_index = is_title == true ? segment.title_positions : segment.value_positions;
+            const bool has_positions = position_index.empty() == false;
+            std::vector<source_util::PhraseWord<T>> words;
+            for (size_t i = 0; i < ordinals.size(); i++) {
+                words.push_back(source_util::PhraseWord<T>{
+                    .postings = posting_index[ordinals[i]],
+                    .block_max_index = &block_max_index,
+                    .ordinal = ordinals[i],
+                    .positions = has_positions == true ? position_index[ordinals[i]] : source_util::PositionList(),
+                    .offset = offsets[i],
+                });
             }
+            std::vector<std::pair<T, uint32_t>> matches;
+            // The deleted documents are never among the results, and must not count toward the BM25 document frequency of the phrase.
+            const source_util::DocumentTable& document_table = runtime_database->document_table;
+            source_util::MatchPhrase(words, term.term->slop, has_positions, [&matches, &document_table](T document_id, uint32_t frequency) {
+                if (document_table.IsDeleted(document_id) == false) {
+                    matches.emplace_back(document_id, frequency);
+                }
+            });
+            PhraseMatches& phrase = phrase_matches.emplace_back();
+            phrase.postings.Append(matches);
+            phrase.postings.ShrinkToFit();
+            phrase.block_maxes.Build(phrase.postings, is_title == true ? runtime_database->title_lengths : runtime_database->value_lengths);
+            term_documents.postings = phrase.postings[0];
+            term_documents.block_max_index = &phrase.block_maxes;
+            term_documents.ordinal = 0;
+            return term_documents;
+        }
+        case QueryCategory::kSites:
+            metadata_index = &segment.site_index;
+            break;
+        case QueryCategory::kLangs:
+            metadata_index = &segment.language_index;
+            break;
+        case QueryCategory::kLocations:
+            metadata_index = &segment.location_index;
+            break;
+        case QueryCategory::kPeople:
+            metadata_index = &segment.person_index;
+            break;
+        case QueryCategory::kOrgs:
+            metadata_index = &segment.organization_index;
+            break;
+        case QueryCategory::kAuthors:
+            metadata_index = &segment.author_index;
+            break;
+        case QueryCategory::kCountries:
+            metadata_index = &segment.country_index;
+            break;
+    }
+    auto document_id_set_iter = metadata_index->find(term.metadata);
+    if (document_id_set_iter != metadata_index->end()) {
+        term_documents.documents = &document_id_set_iter->second;
+    }
+    return term_documents;
+}
 
-            bool has_front_quote = arg_match.front() == '\"';
-            bool has_back_quote = arg_match.back() == '\"';
-            bool back_quote_esc = has_back_quote == true && arg_match[arg_match.size() - 2] == '\\';
-            if ((has_front_quote == true && (has_back_quote == false || back_quote_esc == true)) || (has_front_quote == false && (has_back_quote == true && back_quote_esc == false))) {
-                std::cout << "Invalid quote matching. The following term was skipped: " << arg_match << std::endl;
-                continue;
+template <typename T, typename U, typename V, typename ContainerPolicy>
+std::vector<std::string> SearchEngine<T, U, V, ContainerPolicy>::HandleQuery(const Query& query, std::optional<size_t> result_count) {
+    // The segments only change between queries, so a query reads the same segments from start to finish.
+    this->source_engine_ptr_->ApplyFinishedMerges();
+    Results results;
+    const auto* const runtime_database = this->source_engine_ptr_->GetRuntimeDatabase();
+    const auto& document_table = runtime_database->document_table;
+
+    std::vector<CleanedTerm> cleaned_terms;
+    for (auto&& clause : query.clauses) {
+        for (auto&& term : clause.terms) {
+            cleaned_terms.push_back(this->CleanTerm(clause.category, term));
+        }
+    }
+    // Every term is looked up in every segment before any document is visited, since the BM25 weight of a term depends on how many live documents of the whole database hold it. The deleted documents are left out, so the weight is the same whether or not a merge has dropped their postings yet.
+    std::vector<std::vector<TermDocuments>> segment_term_documents(runtime_database->segments.size());
+    std::vector<size_t> document_frequencies(cleaned_terms.size(), 0);
+    std::deque<PhraseMatches> phrase_matches;
+    for (size_t i = 0; i < runtime_database->segments.size(); i++) {
+        segment_term_documents[i].reserve(cleaned_terms.size());
+        for (size_t j = 0; j < cleaned_terms.size(); j++) {
+            const TermDocuments& term_documents = segment_term_documents[i].emplace_back(this->FindTermDocuments(runtime_database->segments[i], cleaned_terms[j], phrase_matches));
+            // The documents of a phrase are already live, since MatchPhrase skips the deleted ones.
+            if (term_documents.documents == nullptr && term_documents.postings.empty() == false && cleaned_terms[j].term_ids.size() == 1) {
+                document_frequencies[j] += runtime_database->segments[i].LiveCount(cleaned_terms[j].category == QueryCategory::kTitle, term_documents.ordinal);
+            } else {
+                document_frequencies[j] += term_documents.size();
             }
+        }
+    }
+    // The segments hold disjoint ranges of document IDs, so each of them is matched on its own.
+    for (auto&& term_documents : segment_term_documents) {
+        this->EvaluateSegment(cleaned_terms, term_documents, document_frequencies, result_count, results);
+    }
 
-            if (has_front_quote == true && has_back_quote == true && back_quote_esc == false) {
-                arg_match = std::move(arg_match.substr(1, arg_match.size() - 2));
+    // Only the best result_count records are kept, in a heap whose front is the worst record kept so far, so ranking n matches costs O(n log result_count) rather than a sort of all of them. The documents that were deleted since they were indexed are skipped.
+    const bool rank_by_bm25 = this->ranking_mode_ == RankingMode::kBm25;
+    auto ranks_before = [rank_by_bm25](const RankedArticle& a, const RankedArticle& b) { return RanksBefore(a, b, rank_by_bm25); };
+    const size_t kept_count = std::min(result_count.value_or(results.size()), results.size());
+    std::vector<RankedArticle> ranked_articles;
+    ranked_articles.reserve(kept_count);
+    if (kept_count > 0) {
+        for (auto&& result : results) {
+            if (document_table.IsDeleted(result.first) == true) {
+                continue;
             }
+            if (ranked_articles.size() < kept_count) {
+                ranked_articles.push_back(RankedArticle{.document_id = result.first, .appraisal = result.second});
+                std::push_heap(ranked_articles.begin(), ranked_articles.end(), ranks_before);
+            } else if (ranks_before(RankedArticle{.document_id = result.first, .appraisal = result.second}, ranked_articles.front()) == true) {
+                std::pop_heap(ranked_articles.begin(), ranked_articles.end(), ranks_before);
+                ranked_articles.back() = RankedArticle{.document_id = result.first, .appraisal = result.second};
+                std::push_heap(ranked_articles.begin(), ranked_articles.end(), ranks_before);
+            }
+        }
+    }
+    std::sort_heap(ranked_articles.begin(), ranked_articles.end(), ranks_before);
 
-            const auto* const runtime_database = this->source_engine_ptr_->GetRuntimeDatabase();
-            switch (category_hash) {
-                case 312: {  // values case
-                    size_t cleaned_metadata = std::move(this->source_engine_ptr_->CleanValue(arg_match.c_str(), arg_match.size()));
-                    const auto& value_index_vec = runtime_database->value_index;
-                    for (const auto& value_map : value_index_vec) {
-                        auto uuid_count_map_iter = value_map.find(cleaned_metadata);
-                        if (uuid_count_map_iter == value_map.end()) {
-                            continue;
-                        }
-                        for (const auto& uuid_count_pair : uuid_count_map_iter->second) {
-                            auto iter = results.emplace(runtime_database->id_map.at(uuid_count_pair.first), AppraisedArticle{
-                                                                                                                .text_word_count = 0,
-                                                                                                                .title_word_count = 0,
-                                                                                                                .person_count = 0,
-                                                                                                                .organization_count = 0,
-                                                                                                                .author_count = 0,
-                                                                                                                .site_flag = false,
-                                                                                                                .language_flag = false,
-                                                                                                                .location_flag = false,
-                                                                                                                .country_flag = false,
-                                                                                                            });
-                            iter.first->second.text_word_count += uuid_count_pair.second;
-                        }
-                    }
-                    break;
-                }
-                case 326: {  // titles case
-                    size_t cleaned_metadata = std::move(this->source_engine_ptr_->CleanValue(arg_match.c_str(), arg_match.size()));
-                    auto uuid_count_map_iter = runtime_database->title_index.find(cleaned_metadata);
-                    if (uuid_count_map_iter == runtime_database->title_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid_count_pair : uuid_count_map_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid_count_pair.first), AppraisedArticle{
-                                                                                                            .text_word_count = 0,
-                                                                                                            .title_word_count = 0,
-                                                                                                            .person_count = 0,
-                                                                                                            .organization_count = 0,
-                                                                                                            .author_count = 0,
-                                                                                                            .site_flag = false,
-                                                                                                            .language_flag = false,
-                                                                                                            .location_flag = false,
-                                                                                                            .country_flag = false,
-                                                                                                        });
-                        iter.first->second.title_word_count += uuid_count_pair.second;
-                    }
+    // only the matched documents are looked up in the document table, and only once they have been ranked
+    std::vector<std::string> results_vec;
+    results_vec.reserve(ranked_articles.size());
+    for (auto&& ranked_article : ranked_articles) {
+        results_vec.emplace_back(document_table.Path(ranked_article.document_id));
+    }
+    return results_vec;
+}
+
+template <typename T, typename U, typename V, typename ContainerPolicy>
+void SearchEngine<T, U, V, ContainerPolicy>::EvaluateSegment(const std::vector<CleanedTerm>& cleaned_terms, const std::vector<TermDocuments>& term_documents, const std::vector<size_t>& document_frequencies, std::optional<size_t> result_count, Results& results) {
+    const auto* const runtime_database = this->source_engine_ptr_->GetRuntimeDatabase();
+    const auto& document_table = runtime_database->document_table;
+    // The document count of BM25, like its document frequencies, leaves the deleted documents out.
+    const size_t live_document_count = document_table.size() - document_table.deleted_count();
+
+    std::vector<const TermDocuments*> required_terms;
+    std::vector<const TermDocuments*> excluded_terms;
+    bool has_metadata_terms = false;
+    for (size_t i = 0; i < cleaned_terms.size(); i++) {
+        if (cleaned_terms[i].occurrence == QueryOccurrence::kMust) {
+            required_terms.push_back(&term_documents[i]);
+        } else if (cleaned_terms[i].occurrence == QueryOccurrence::kMustNot) {
+            excluded_terms.push_back(&term_documents[i]);
+            continue;
+        }
+        if (cleaned_terms[i].category != QueryCategory::kValues && cleaned_terms[i].category != QueryCategory::kTitle) {
+            has_metadata_terms = true;
+        }
+    }
+
+    // A query with required terms only matches the documents that hold all of them and none of the excluded terms, which are found by intersecting the terms before the other terms are read.
+    std::optional<std::vector<T>> allowed_documents;
+    if (required_terms.empty() == false) {
+        allowed_documents = source_util::IntersectDocuments(required_terms, excluded_terms);
+    }
+    const std::vector<T>* const allowed = allowed_documents.has_value() == true ? &allowed_documents.value() : nullptr;
+
+    // In RankingMode::kBm25, the values and title terms are only scored once the whole query has been read, since a query without meta-data terms can skip most of their postings.
+    std::vector<source_util::WandTerm<T>> bm25_terms;
+    for (size_t i = 0; i < cleaned_terms.size(); i++) {
+        if (cleaned_terms[i].occurrence == QueryOccurrence::kMustNot) {
+            continue;
+        }
+        const QueryCategory category = cleaned_terms[i].category;
+        if (this->ranking_mode_ == RankingMode::kBm25 && (category == QueryCategory::kValues || category == QueryCategory::kTitle)) {
+            if (term_documents[i].postings.empty() == false) {
+                bm25_terms.push_back(source_util::WandTerm<T>{
+                    .postings = term_documents[i].postings,
+                    .document_frequency = document_frequencies[i],
+                    .field = category == QueryCategory::kTitle ? &runtime_database->title_lengths : &runtime_database->value_lengths,
+                    .block_max_index = term_documents[i].block_max_index,
+                    .ordinal = term_documents[i].ordinal,
+                });
+            }
+            continue;
+        }
+        source_util::ForEachMatch(term_documents[i], allowed, [&results, category](T document_id, uint32_t count) {
+            auto iter = results.emplace(document_id, AppraisedArticle{
+                                                         .text_word_count = 0,
+                                                         .title_word_count = 0,
+                                                         .person_count = 0,
+                                                         .organization_count = 0,
+                                                         .author_count = 0,
+                                                         .site_flag = false,
+                                                         .language_flag = false,
+                                                         .location_flag = false,
+                                                         .country_flag = false,
+                                                         .bm25_score = 0,
+                                                     });
+            AppraisedArticle& appraisal = iter.first->second;
+            switch (category) {
+                case QueryCategory::kValues:
+                    appraisal.text_word_count += count;
                     break;
-                }
-                case 325: {  // sites case
-                    std::string cleaned_metadata = std::move(this->source_engine_ptr_->CleanMetaData(arg_match.c_str(), arg_match.size()));
-                    auto uuid_set_iter = runtime_database->site_index.find(cleaned_metadata);
-                    if (uuid_set_iter == runtime_database->site_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid : uuid_set_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid), AppraisedArticle{
-                                                                                           .text_word_count = 0,
-                                                                                           .title_word_count = 0,
-                                                                                           .person_count = 0,
-                                                                                           .organization_count = 0,
-                                                                                           .author_count = 0,
-                                                                                           .site_flag = false,
-                                                                                           .language_flag = false,
-                                                                                           .location_flag = false,
-                                                                                           .country_flag = false,
-                                                                                       });
-                        iter.first->second.site_flag = true;
-                    }
+                case QueryCategory::kTitle:
+                    appraisal.title_word_count += count;
                     break;
-                }
-                case 302: {  // langs case
-                    std::string cleaned_metadata = std::move(this->source_engine_ptr_->CleanMetaData(arg_match.c_str(), arg_match.size()));
-                    auto uuid_set_iter = runtime_database->language_index.find(cleaned_metadata);
-                    if (uuid_set_iter == runtime_database->language_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid : uuid_set_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid), AppraisedArticle{
-                                                                                           .text_word_count = 0,
-                                                                                           .title_word_count = 0,
-                                                                                           .person_count = 0,
-                                                                                           .organization_count = 0,
-                                                                                           .author_count = 0,
-                                                                                           .site_flag = false,
-                                                                                           .language_flag = false,
-                                                                                           .location_flag = false,
-                                                                                           .country_flag = false,
-                                                                                       });
-                        iter.first->second.language_flag = true;
-                    }
+                case QueryCategory::kSites:
+                    appraisal.site_flag = true;
                     break;
-                }
-                case 330: {  // locations case
-                    std::string cleaned_metadata = std::move(this->source_engine_ptr_->CleanMetaData(arg_match.c_str(), arg_match.size()));
-                    auto uuid_set_iter = runtime_database->location_index.find(cleaned_metadata);
-                    if (uuid_set_iter == runtime_database->location_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid : uuid_set_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid), AppraisedArticle{
-                                                                                           .text_word_count = 0,
-                                                                                           .title_word_count = 0,
-                                                                                           .person_count = 0,
-                                                                                           .organization_count = 0,
-                                                                                           .author_count = 0,
-                                                                                           .site_flag = false,
-                                                                                           .language_flag = false,
-                                                                                           .location_flag = false,
-                                                                                           .country_flag = false,
-                                                                                       });
-                        iter.first->second.location_flag = true;
-                    }
+                case QueryCategory::kLangs:
+                    appraisal.language_flag = true;
                     break;
-                }
-                case 314: {  // people case
-                    std::string cleaned_metadata = std::move(this->source_engine_ptr_->CleanMetaData(arg_match.c_str(), arg_match.size()));
-                    auto uuid_set_iter = runtime_database->person_index.find(cleaned_metadata);
-                    if (uuid_set_iter == runtime_database->person_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid : uuid_set_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid), AppraisedArticle{
-                                                                                           .text_word_count = 0,
-                                                                                           .title_word_count = 0,
-                                                                                           .person_count = 0,
-                                                                                           .organization_count = 0,
-                                                                                           .author_count = 0,
-                                                                                           .site_flag = false,
-                                                                                           .language_flag = false,
-                                                                                           .location_flag = false,
-                                                                                           .country_flag = false,
-                                                                                       });
-                        iter.first->second.person_count++;
-                    }
+                case QueryCategory::kLocations:
+                    appraisal.location_flag = true;
                     break;
-                }
-                case 339: {  // orgs case
-                    std::string cleaned_metadata = std::move(this->source_engine_ptr_->CleanMetaData(arg_match.c_str(), arg_match.size()));
-                    auto uuid_set_iter = runtime_database->organization_index.find(cleaned_metadata);
-                    if (uuid_set_iter == runtime_database->organization_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid : uuid_set_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid), AppraisedArticle{
-                                                                                           .text_word_count = 0,
-                                                                                           .title_word_count = 0,
-                                                                                           .person_count = 0,
-                                                                                           .organization_count = 0,
-                                                                                           .author_count = 0,
-                                                                                           .site_flag = false,
-                                                                                           .language_flag = false,
-                                                                                           .location_flag = false,
-                                                                                           .country_flag = false,
-                                                                                       });
-                        iter.first->second.organization_count++;
-                    }
+                case QueryCategory::kPeople:
+                    appraisal.person_count++;
                     break;
-                }
-                case 331: {  // authors case
-                    std::string cleaned_metadata = std::move(this->source_engine_ptr_->CleanMetaData(arg_match.c_str(), arg_match.size()));
-                    auto uuid_set_iter = runtime_database->author_index.find(cleaned_metadata);
-                    if (uuid_set_iter == runtime_database->author_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid : uuid_set_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid), AppraisedArticle{
-                                                                                           .text_word_count = 0,
-                                                                                           .title_word_count = 0,
-                                                                                           .person_count = 0,
-                                                                                           .organization_count = 0,
-                                                                                           .author_count = 0,
-                                                                                           .site_flag = false,
-                                                                                           .language_flag = false,
-                                                                                           .location_flag = false,
-                                                                                           .country_flag = false,
-                                                                                       });
-                        iter.first->second.author_count++;
-                    }
+                case QueryCategory::kOrgs:
+                    appraisal.organization_count++;
                     break;
-                }
-                case 321: {  // countries case
-                    std::string cleaned_metadata = std::move(this->source_engine_ptr_->CleanMetaData(arg_match.c_str(), arg_match.size()));
-                    auto uuid_set_iter = runtime_database->country_index.find(cleaned_metadata);
-                    if (uuid_set_iter == runtime_database->country_index.end()) {
-                        break;
-                    }
-                    for (const auto& uuid : uuid_set_iter->second) {
-                        auto iter = results.emplace(runtime_database->id_map.at(uuid), AppraisedArticle{
-                                                                                           .text_word_count = 0,
-                                                                                           .title_word_count = 0,
-                                                                                           .person_count = 0,
-                                                                                           .organization_count = 0,
-                                                                                           .author_count = 0,
-                                                                                           .site_flag = false,
-                                                                                           .language_flag = false,
-                                                                                           .location_flag = false,
-                                                                                           .country_flag = false,
-                                                                                       });
-                        iter.first->second.country_flag = true;
-                    }
+                case QueryCategory::kAuthors:
+                    appraisal.author_count++;
                     break;
-                }
-                default:
+                case QueryCategory::kCountries:
+                    appraisal.country_flag = true;
                     break;
             }
+        });
+    }
+
+    if (result_count.has_value() == true && has_metadata_terms == false && required_terms.empty() == true && excluded_terms.empty() == true) {
+        // The ranking then only depends on the BM25 score, so Block-Max WAND can find the best result_count documents of the segment without scoring every posting. The best of the whole database are among the best of its segments.
+        auto is_deleted = [&document_table](T document_id) { return document_table.IsDeleted(document_id); };
+        for (auto&& scored_document : source_util::BlockMaxWand(bm25_terms, live_document_count, result_count.value(), is_deleted)) {
+            results.emplace(scored_document.document_id, AppraisedArticle{
+                                                             .text_word_count = 0,
+                                                             .title_word_count = 0,
+                                                             .person_count = 0,
+                                                             .organization_count = 0,
+                                                             .author_count = 0,
+                                                             .site_flag = false,
+                                                             .language_flag = false,
+                                                             .location_flag = false,
+                                                             .country_flag = false,
+                                                             .bm25_score = scored_document.score,
+                                                         });
+        }
+    } else {
+        for (auto&& bm25_term : bm25_terms) {
+            auto add_score = [&results](T document_id, double score) {
+                auto iter = results.emplace(document_id, AppraisedArticle{
+                                                             .text_word_count = 0,
+                                                             .title_word_count = 0,
+                                                             .person_count = 0,
+                                                             .organization_count = 0,
+                                                             .author_count = 0,
+                                                             .site_flag = false,
+                                                             .language_flag = false,
+                                                             .location_flag = false,
+                                                             .country_flag = false,
+                                                             .bm25_score = 0,
+                                                         });
+                iter.first->second.bm25_score += score;
+            };
+            if (allowed == nullptr) {
+                source_util::ScoreBm25(bm25_term.postings, bm25_term.document_frequency, *bm25_term.field, live_document_count, add_score);
+                continue;
+            }
+            const double weight = source_util::Bm25Idf(bm25_term.document_frequency, live_document_count) * (source_util::kBm25K1 + 1);
+            const float* const norms = bm25_term.field->norms.data();
+            const TermDocuments bm25_term_documents = {.postings = bm25_term.postings, .block_max_index = bm25_term.block_max_index, .ordinal = bm25_term.ordinal, .documents = nullptr};
+            source_util::ForEachMatch(bm25_term_documents, allowed, [&add_score, weight, norms](T document_id, uint32_t term_frequency) { add_score(document_id, source_util::Bm25PostingScore(weight, term_frequency, norms[document_id])); });
         }
     }
 
-    std::vector<std::string> results_vec;
-    for (auto&& result : results) {
-        results_vec.push_back(result.first);
+    // Without required terms, the excluded terms are taken out of the union of the other terms once it is complete.
+    if (required_terms.empty() == true) {
+        for (auto&& excluded_term : excluded_terms) {
+            source_util::ForEachMatch(*excluded_term, allowed, [&results](T document_id, uint32_t) { results.erase(document_id); });
+        }
     }
-    // sort contents of results_vec by the int value of the pair in results
-    std::sort(results_vec.begin(), results_vec.end(), [&results](const std::string& a, const std::string& b) {
-        // prioritize language, then site, then other metadata flags country and location.
-        // finally, prioritize title word count, then organization count, then person count, then author count, and then the text word count
+}
 
-        auto& result_a = results.at(a);
-        auto& result_b = results.at(b);
+template <typename T, typename U, typename V, typename ContainerPolicy>
+bool SearchEngine<T, U, V, ContainerPolicy>::RanksBefore(const RankedArticle& a, const RankedArticle& b, bool rank_by_bm25) {
+    // prioritize language, then site, then other metadata flags country and location.
+    // finally, prioritize title word count, then organization count, then person count, then author count, and then the text word count
+    const AppraisedArticle& result_a = a.appraisal;
+    const AppraisedArticle& result_b = b.appraisal;
 
-        if (result_a.language_flag != result_b.language_flag) {
-            return result_a.language_flag;
-        }
-        if (result_a.site_flag != result_b.site_flag) {
-            return result_a.site_flag;
-        }
-        if (result_a.country_flag != result_b.country_flag) {
-            return result_a.country_flag;
-        }
-        if (result_a.location_flag != result_b.location_flag) {
-            return result_a.location_flag;
-        }
+    if (result_a.language_flag != result_b.language_flag) {
+        return result_a.language_flag;
+    }
+    if (result_a.site_flag != result_b.site_flag) {
+        return result_a.site_flag;
+    }
+    if (result_a.country_flag != result_b.country_flag) {
+        return result_a.country_flag;
+    }
+    if (result_a.location_flag != result_b.location_flag) {
+        return result_a.location_flag;
+    }
+    // BM25 stands in for the title and value counts, which it already weighs against the length of each document
+    if (rank_by_bm25 == true && result_a.bm25_score != result_b.bm25_score) {
+        return result_a.bm25_score > result_b.bm25_score;
+    }
 
-        if (result_a.title_word_count != result_b.title_word_count) {
-            return result_a.title_word_count > result_b.title_word_count;
-        }
-        if (result_a.organization_count != result_b.organization_count) {
-            return result_a.organization_count > result_b.organization_count;
-        }
-        if (result_a.person_count != result_b.person_count) {
-            return result_a.person_count > result_b.person_count;
-        }
-        if (result_a.author_count != result_b.author_count) {
-            return result_a.author_count > result_b.author_count;
-        }
+    if (result_a.title_word_count != result_b.title_word_count) {
+        return result_a.title_word_count > result_b.title_word_count;
+    }
+    if (result_a.organization_count != result_b.organization_count) {
+        return result_a.organization_count > result_b.organization_count;
+    }
+    if (result_a.person_count != result_b.person_count) {
+        return result_a.person_count > result_b.person_count;
+    }
+    if (result_a.author_count != result_b.author_count) {
+        return result_a.author_count > result_b.author_count;
+    }
+    if (result_a.text_word_count != result_b.text_word_count) {
         return result_a.text_word_count > result_b.text_word_count;
-    });
-    return results_vec;
+    }
+    // ties are broken by document ID, so the ranking does not depend on the iteration order of the results container
+    return a.document_id < b.document_id;
 }
 
 }  // namespace search_engine
@@ -0,0 +1,107 @@
+#ifndef SEARCH_ENGINE_PROJECT_SORTEDVECTORMAP_H_
+#define SEARCH_ENGINE_PROJECT_SORTEDVECTORMAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief A read-only map that keeps its elements in one vector sorted by key, and finds them with a binary search.
+ * @details It is built in one go from any other map, so it costs no more than its elements and has no per-element allocations or empty slots. It is meant for indexes that are only read once they have been built.
+ */
+template <typename K, typename V>
+class SortedVectorMap {
+   public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K, V>;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+    using iterator = const_iterator;
+
+    SortedVectorMap() = default;
+
+    /*!
+     * @brief Builds the map from any map-like range of {key, value} pairs with unique keys, converting each value to V.
+     */
+    template <typename Map, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Map>, SortedVectorMap>>>
+    explicit SortedVectorMap(const Map& map) {
+        this->elements_.reserve(map.size());
+        for (auto&& element : map) {
+            this->elements_.emplace_back(element.first, V(element.second));
+        }
+        std::sort(this->elements_.begin(), this->elements_.end(), [](const value_type& a, const value_type& b) { return a.first < b.first; });
+    }
+
+    inline const_iterator begin() const { return this->elements_.begin(); }
+    inline const_iterator end() const { return this->elements_.end(); }
+    inline size_t size() const { return this->elements_.size(); }
+    inline bool empty() const { return this->elements_.empty(); }
+
+    const_iterator find(const K& key) const {
+        auto iter = std::lower_bound(this->elements_.begin(), this->elements_.end(), key, [](const value_type& element, const K& key) { return element.first < key; });
+        return iter != this->elements_.end() && iter->first == key ? iter : this->elements_.end();
+    }
+
+    inline size_t count(const K& key) const { return this->find(key) != this->end() ? 1 : 0; }
+
+    inline void clear() { this->elements_ = std::vector<value_type>(); }
+
+    inline bool operator==(const SortedVectorMap& other) const { return this->elements_ == other.elements_; }
+    inline bool operator!=(const SortedVectorMap& other) const { return this->elements_ != other.elements_; }
+
+   private:
+    std::vector<value_type> elements_;
+};
+
+/*!
+ * @brief A read-only set that keeps its elements in one sorted vector. See SortedVectorMap.
+ */
+template <typename K>
+class SortedVectorSet {
+   public:
+    using key_type = K;
+    using value_type = K;
+    using const_iterator = typename std::vector<K>::const_iterator;
+    using iterator = const_iterator;
+
+    SortedVectorSet() = default;
+
+    /*!
+     * @brief Builds the set from any range of unique keys.
+     */
+    template <typename Set, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Set>, SortedVectorSet>>>
+    explicit SortedVectorSet(const Set& set) : elements_(set.begin(), set.end()) {
+        std::sort(this->elements_.begin(), this->elements_.end());
+    }
+
+    inline const_iterator begin() const { return this->elements_.begin(); }
+    inline const_iterator end() const { return this->elements_.end(); }
+    inline size_t size() const { return this->elements_.size(); }
+    inline bool empty() const { return this->elements_.empty(); }
+
+    const_iterator find(const K& key) const {
+        auto iter = std::lower_bound(this->elements_.begin(), this->elements_.end(), key);
+        return iter != this->elements_.end() && *iter == key ? iter : this->elements_.end();
+    }
+
+    inline size_t count(const K& key) const { return this->find(key) != this->end() ? 1 : 0; }
+
+    inline void clear() { this->elements_ = std::vector<K>(); }
+
+    inline bool operator==(const SortedVectorSet& other) const { return this->elements_ == other.elements_; }
+    inline bool operator!=(const SortedVectorSet& other) const { return this->elements_ != other.elements_; }
+
+   private:
+    std::vector<K> elements_;
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_SORTEDVECTORMAP_H_
\ No newline at end of file
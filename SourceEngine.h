@@ -1,50 +1,207 @@
 #ifndef SEARCH_ENGINE_PROJECT_SOURCEENGINE_H_
 #define SEARCH_ENGINE_PROJECT_SOURCEENGINE_H_
 
+#include <algorithm>
+#include <limits>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "BlockMaxWand.h"
+#include "Bm25.h"
+#include "ContainerPolicy.h"
+#include "DocumentTable.h"
+#include "PositionIndex.h"
+#include "PostingList.h"
+#include "TermDictionary.h"
+
 namespace search_engine {
 
 namespace source_util {
 
+/*!
+ * @brief How the term IDs of a sharded index are spread over its shards: term ID % shard_count picks the shard of a term, and term ID / shard_count is its slot within that shard.
+ * @details Every reader and writer of a sharded index goes through this struct rather than through the thread count that happened to build it, so the layout of the index is stated in one place, and one term always maps to exactly one {shard, slot} pair.
+ */
+struct TermSharding {
+    size_t shard_count = 1;
+
+    inline size_t Shard(size_t term_id) const { return term_id % this->shard_count; }
+    inline size_t Slot(size_t term_id) const { return term_id / this->shard_count; }
+    // The inverse of Shard and Slot.
+    inline size_t TermId(size_t shard, size_t slot) const { return slot * this->shard_count + shard; }
+};
+
+/*!
+ * @brief The indexes of the documents one batch of sources was parsed into, which are the documents [first_document_id, end_document_id) of a RunTimeDatabase.
+ * @details A segment never changes once it has been frozen, apart from how many of its postings belong to documents deleted since, and later batches go into segments of their own, until a merge replaces it and its neighbours with a single segment that holds all of their documents but the deleted ones. Its posting, block-max and position lists are indexed by the ordinal of a term, which is the subscript of its term ID in term_ids, rather than by term ID, so a segment only costs memory for the terms its own documents hold.
+ * @tparam T The unsigned integer type used for the dense document IDs.
+ * @tparam V The data type used to store the meta-data of each source.
+ * @tparam ContainerPolicy The containers of the meta-data indexes.
+ */
+template <typename T, typename V, typename ContainerPolicy = StdContainerPolicy>
+struct Segment {
+    using MetadataIndex = typename ContainerPolicy::template MetadataMap<V, typename ContainerPolicy::template DocumentSet<T>>;  // meta-data value -> document IDs
+
+    // The value returned by Ordinal for a term that no document of the segment holds.
+    static constexpr size_t kNoOrdinal = std::numeric_limits<size_t>::max();
+
+    T first_document_id = 0;
+    T end_document_id = 0;
+    T document_count = 0;                // the documents of [first_document_id, end_document_id) that the segment holds postings for, which are all of them but the deleted documents a merge dropped
+    MappableArray<uint32_t> term_ids;    // ordinal -> term ID, in increasing order, of every term that has value or title postings in the segment
+    PostingIndex<T> value_postings;      // ordinal -> compressed {document ID -> count} list
+    PostingIndex<T> title_postings;      // ordinal -> compressed {document ID -> count} list
+    BlockMaxIndex<T> value_block_maxes;  // ordinal -> BM25 upper bounds and skip data of its value_postings list
+    BlockMaxIndex<T> title_block_maxes;  // ordinal -> BM25 upper bounds and skip data of its title_postings list
+    PositionIndex<T> value_positions;    // ordinal -> compressed token positions of every document of its value_postings list, only filled if positions are recorded
+    PositionIndex<T> title_positions;    // ordinal -> compressed token positions of every document of its title_postings list, only filled if positions are recorded
+    MappableArray<uint32_t> value_deleted_counts;  // ordinal -> amount of deleted documents in its value_postings list, only filled if the segment holds deleted documents
+    MappableArray<uint32_t> title_deleted_counts;  // ordinal -> amount of deleted documents in its title_postings list, only filled if the segment holds deleted documents
+    MetadataIndex site_index;
+    MetadataIndex language_index;
+    MetadataIndex location_index;
+    MetadataIndex person_index;
+    MetadataIndex organization_index;
+    MetadataIndex author_index;
+    MetadataIndex country_index;
+
+    /*!
+     * @brief Returns the ordinal of the given term ID in the segment, or kNoOrdinal if no document of the segment holds the term.
+     */
+    inline size_t Ordinal(size_t term_id) const {
+        const uint32_t* const iter = std::lower_bound(this->term_ids.begin(), this->term_ids.end(), term_id);
+        return iter != this->term_ids.end() && *iter == term_id ? iter - this->term_ids.begin() : kNoOrdinal;
+    }
+
+    /*!
+     * @brief Returns the amount of documents of the given posting list of the segment that have not been deleted, which is what the list adds to the BM25 document frequency of its term.
+     */
+    inline size_t LiveCount(bool from_title_postings, size_t ordinal) const {
+        const PostingIndex<T>& posting_index = from_title_postings == true ? this->title_postings : this->value_postings;
+        const MappableArray<uint32_t>& deleted_counts = from_title_postings == true ? this->title_deleted_counts : this->value_deleted_counts;
+        return posting_index[ordinal].size() - (deleted_counts.empty() == true ? 0 : deleted_counts[ordinal]);
+    }
+
+    /*!
+     * @brief Recounts value_deleted_counts and title_deleted_counts from the deleted documents of the given table. Must be called whenever documents of the segment are deleted, since a deleted document keeps its postings until a merge drops them.
+     */
+    void CountDeletedPostings(const DocumentTable& document_table) {
+        this->value_deleted_counts.clear();
+        this->title_deleted_counts.clear();
+        if (document_table.DeletedCount(this->first_document_id, this->end_document_id) == 0) {
+            return;
+        }
+        for (bool from_title_postings : {false, true}) {
+            const PostingIndex<T>& posting_index = from_title_postings == true ? this->title_postings : this->value_postings;
+            MappableArray<uint32_t>& deleted_counts = from_title_postings == true ? this->title_deleted_counts : this->value_deleted_counts;
+            deleted_counts.reserve(posting_index.size());
+            for (size_t ordinal = 0; ordinal < posting_index.size(); ordinal++) {
+                uint32_t deleted_count = 0;
+                for (auto&& posting : posting_index[ordinal]) {
+                    deleted_count += document_table.IsDeleted(posting.first) == true ? 1 : 0;
+                }
+                deleted_counts.push_back(deleted_count);
+            }
+        }
+    }
+};
+
 /*!
  * @brief A struct that contains all of the indexes that are used to store the data parsed from a file by a SourceEngine object.
- * @tparam T The data type you wish to use to store the ID of each source.
- * @tparam U The data type you wish to use to store the values to be indexed and the titles of the sources to be indexed.
+ * @details The documents are split into segments, one per batch of sources that was parsed. The term dictionary, the document table and the document lengths are shared by every segment, so a term ID and a document ID mean the same thing in every segment, and the BM25 statistics of a term span the whole database.
+ * @tparam T The unsigned integer type used for the dense document IDs that document_table hands out to the sources.
+ * @tparam U The unsigned integer type used for the term IDs that term_dictionary hands out to the values and the titles of the sources to be indexed.
  * @tparam V The data type you wish to use to store the meta-data of each source. This template parameter is optional, and defaults to the same type as the U template parameter.
- * @warning Not all of the indexes in this struct are guaranteed to be filled by a SourceEngine object. For example, a SourceEngine object that only parses files only containing test will not fill the site_index, language_index, location_index, person_index, organization_index, author_index, or country_index indexes.
+ * @tparam ContainerPolicy The containers of the indexes, such as source_util::StdContainerPolicy or source_util::CompactContainerPolicy. See ContainerPolicy.h.
+ * @warning Not all of the indexes in this struct are guaranteed to be filled by a SourceEngine object. For example, a SourceEngine object that only parses files only containing test will not fill the site_index, language_index, location_index, person_index, organization_index, author_index, or country_index indexes of its segments.
  */
-template <typename T, typename U, typename V = U>
+template <typename T, typename U, typename V = U, typename ContainerPolicy = StdContainerPolicy>
 struct RunTimeDatabase {
-    std::unordered_map<T, std::string> id_map;                                        // uuid -> file path
-    std::vector<std::unordered_map<U, std::unordered_map<T, uint32_t>>> value_index;  // vector of {word -> {uuid -> count}}
-    std::unordered_map<U, std::unordered_map<T, uint32_t>> title_index;
-    std::unordered_map<V, std::unordered_set<T>> site_index;
-    std::unordered_map<V, std::unordered_set<T>> language_index;
-    std::unordered_map<V, std::unordered_set<T>> location_index;
-    std::unordered_map<V, std::unordered_set<T>> person_index;
-    std::unordered_map<V, std::unordered_set<T>> organization_index;
-    std::unordered_map<V, std::unordered_set<T>> author_index;
-    std::unordered_map<V, std::unordered_set<T>> country_index;
+    using PostingMap = typename ContainerPolicy::template HashMap<T, uint32_t>;  // document ID -> count
+    using Segment = source_util::Segment<T, V, ContainerPolicy>;
+    using MetadataIndex = typename Segment::MetadataIndex;
+
+    TermDictionary term_dictionary;                    // value and title term -> term ID
+    DocumentTable document_table;                      // document ID -> file path, and whether the document was deleted
+    FieldLengths value_lengths;                        // document ID -> amount of value tokens, and their BM25 norms
+    FieldLengths title_lengths;                        // document ID -> amount of title tokens, and their BM25 norms
+    std::vector<Segment> segments;                     // in increasing document ID order, where every document belongs to exactly one segment
+    TermSharding value_sharding;                       // the layout of the shards of value_index
+    std::vector<std::vector<PostingMap>> value_index;  // only filled while sources are parsed, and then encoded into the value_postings of a new segment: vector of shards, where shard value_sharding.Shard(t) holds the {document ID -> count} map of term ID t at slot value_sharding.Slot(t)
+    std::vector<PostingMap> title_index;               // only filled while sources are parsed, and then encoded into the title_postings of a new segment: term ID -> {document ID -> count}
 };
 
 /*!
- * @tparam T The data type you wish to use to store the ID of each source.
- * @tparam U The data type you wish to use to store the values to be indexed.
+ * @brief Returns whether the two given RunTimeDatabase objects hold exactly the same data, in the same segments, regardless of which term IDs the terms were given.
+ * @details This is meant to check that a database filled by many threads matches one filled by a single thread.
+ */
+template <typename T, typename U, typename V, typename ContainerPolicy>
+bool HasSameContents(const RunTimeDatabase<T, U, V, ContainerPolicy>& lhs, const RunTimeDatabase<T, U, V, ContainerPolicy>& rhs) {
+    using Segment = typename RunTimeDatabase<T, U, V, ContainerPolicy>::Segment;
+    // The positions of a term are compared as raw bytes, since a list of positions only has one encoding.
+    auto postings_by_term = [](const RunTimeDatabase<T, U, V, ContainerPolicy>& database, const Segment& segment, bool from_title_postings) {
+        const PostingIndex<T>& posting_index = from_title_postings == true ? segment.title_postings : segment.value_postings;
+        const PositionIndex<T>& position_index = from_title_postings == true ? segment.title_positions : segment.value_positions;
+        std::unordered_map<std::string_view, std::pair<PostingList<T>, std::string_view>> postings_map;
+        for (size_t ordinal = 0; ordinal < posting_index.size(); ordinal++) {
+            if (posting_index[ordinal].empty() == false) {
+                std::string_view positions;
+                if (ordinal < position_index.size()) {
+                    const PositionList position_list = position_index[ordinal];
+                    positions = std::string_view((const char*)position_list.data(), position_list.end() - position_list.data());
+                }
+                postings_map.emplace(database.term_dictionary.Term(segment.term_ids[ordinal]), std::make_pair(posting_index[ordinal], positions));
+            }
+        }
+        return postings_map;
+    };
+    auto same_postings = [&postings_by_term, &lhs, &rhs](const Segment& lhs_segment, const Segment& rhs_segment, bool from_title_postings) {
+        const auto lhs_postings_map = postings_by_term(lhs, lhs_segment, from_title_postings);
+        const auto rhs_postings_map = postings_by_term(rhs, rhs_segment, from_title_postings);
+        if (lhs_postings_map.size() != rhs_postings_map.size()) {
+            return false;
+        }
+        for (auto&& term_postings_pair : lhs_postings_map) {
+            auto iter = rhs_postings_map.find(term_postings_pair.first);
+            if (iter == rhs_postings_map.end() || iter->second != term_postings_pair.second) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    bool same_contents = lhs.document_table == rhs.document_table && lhs.value_lengths == rhs.value_lengths && lhs.title_lengths == rhs.title_lengths && lhs.segments.size() == rhs.segments.size();
+    for (size_t i = 0; i < lhs.segments.size() && same_contents == true; i++) {
+        const Segment& lhs_segment = lhs.segments[i];
+        const Segment& rhs_segment = rhs.segments[i];
+        same_contents = lhs_segment.first_document_id == rhs_segment.first_document_id && lhs_segment.end_document_id == rhs_segment.end_document_id && lhs_segment.document_count == rhs_segment.document_count && lhs_segment.site_index == rhs_segment.site_index && lhs_segment.language_index == rhs_segment.language_index &&
+                        lhs_segment.location_index == rhs_segment.location_index && lhs_segment.person_index == rhs_segment.person_index && lhs_segment.organization_index == rhs_segment.organization_index && lhs_segment.author_index == rhs_segment.author_index &&
+                        lhs_segment.country_index == rhs_segment.country_index && same_postings(lhs_segment, rhs_segment, false) && same_postings(lhs_segment, rhs_segment, true);
+    }
+    return same_contents;
+}
+
+/*!
+ * @tparam T The unsigned integer type used for the dense document IDs of the sources.
+ * @tparam U The unsigned integer type used for the term IDs of the values to be indexed.
  * @tparam V The data type you wish to use to store the meta-data of each source.
+ * @tparam ContainerPolicy The container policy of the RunTimeDatabase object that is filled.
  */
-template <typename T, typename U, typename V = U>
+template <typename T, typename U, typename V = U, typename ContainerPolicy = StdContainerPolicy>
 class SourceEngine {
    public:
     /*!
+     * @brief Parses the sources found at the given path into a new segment of the RunTimeDatabase object. A source that has already been parsed from the same path is skipped, unless its file has changed since, in which case its old document is deleted and the file is parsed again.
+     * @details Sources are told apart by the path they were found at, so the same spelling of a folder should be given every time it is parsed. The document of a source that was parsed from the given folder before, but whose file is not there anymore, is deleted as well.
      * @warning The optional `stop_words_ptr` pointer parameter, if supplied to this function, must outlive this functions entire execution.
      * @param path The file path of the file or folder of files you desire to parse and fill a RunTimeDatabase object with.
-     * @param stop_words_ptr An optional parameter that is a constant pointer to an unordered_set of stop words.
+     * @param stop_words_ptr An optional parameter that is a constant pointer to an unordered_set of stop words, which are cleaned like any other value before they are matched.
      */
-    virtual void ParseSources(std::string path, const std::unordered_set<U>* const stop_words_ptr = NULL) = 0;
+    virtual void ParseSources(std::string path, const std::unordered_set<std::string>* const stop_words_ptr = NULL) = 0;
 
     /*!
      * @brief Displays the source with the given file_path to the console.
@@ -56,18 +213,10 @@ class SourceEngine {
     virtual inline void ClearRuntimeDatabase() = 0;
 
     /*!
-     * @brief Cleans the given char* id_token and returns the cleaned id_token in the T data type. This function should be used when parsing a file to clean the id of a source, and it should be used when querying the RunTimeDatabase object.
-     * @param id_token The char* id_token to be cleaned.
-     * @param size The size of the char* id_token to be cleaned. This parameter is optional, and defaults to std::nullopt.
-     * @return The cleaned id_token in the T data type.
-     */
-    virtual T CleanID(const char* const id_token, std::optional<size_t> size = std::nullopt) = 0;
-
-    /*!
-     * @brief Cleans the given char* value_token and returns the cleaned value_token in the U data type. This function should be used when parsing a file to clean the value tokens in a source, and it should be used when querying the RunTimeDatabase object.
+     * @brief Cleans the given char* value_token and looks it up in the term dictionary of the RunTimeDatabase object. This function should be used when querying the value_postings and title_postings of the RunTimeDatabase object.
      * @param value_token The char* value_token to be cleaned.
      * @param size The size of the char* value_token to be cleaned. This parameter is optional, and defaults to std::nullopt.
-     * @return The cleaned value_token in the U data type.
+     * @return The term ID of the cleaned value_token, or source_util::TermDictionary::kNoTerm if the cleaned value_token was never indexed.
      */
     virtual U CleanValue(const char* const value_token, std::optional<size_t> size = std::nullopt) = 0;
 
@@ -79,11 +228,24 @@ class SourceEngine {
      */
     virtual V CleanMetaData(const char* const metadata_token, std::optional<size_t> size = std::nullopt) = 0;
 
+    /*!
+     * @brief Splits the given phrase into value tokens exactly like the sources were split, and looks each of them up in the term dictionary of the RunTimeDatabase object. This function should be used when querying the value_positions and title_positions of the RunTimeDatabase object.
+     * @param phrase The phrase to be split, which is not modified.
+     * @param size The size of the phrase.
+     * @return The term ID of every token of the phrase, in order, where a token that was never indexed is source_util::TermDictionary::kNoTerm, and a token between two others that cannot be indexed is source_util::TermDictionary::kAnyTerm.
+     */
+    virtual std::vector<U> CleanPhrase(const char* const phrase, size_t size) = 0;
+
     /*!
      * @brief Returns the RunTimeDatabase owned by the invoked SourceEngine object.
      * @warning The return value should not be deleted, and the use of the return value should be restricted to the lifetime of the invoked SourceEngine object.
      */
-    virtual inline const RunTimeDatabase<T, U, V>* const GetRuntimeDatabase() const = 0;
+    virtual inline const RunTimeDatabase<T, U, V, ContainerPolicy>* GetRuntimeDatabase() const = 0;
+
+    /*!
+     * @brief Swaps the segments that a background merge has finished building into the RunTimeDatabase object, in place of the segments they were merged from. This function should be called by the thread that queries the RunTimeDatabase object, before every query, since the RunTimeDatabase object only changes when it is called.
+     */
+    virtual void ApplyFinishedMerges() = 0;
 
     virtual ~SourceEngine() = default;
 };
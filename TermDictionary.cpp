@@ -0,0 +1,158 @@
+#include "TermDictionary.h"
+
+#include <algorithm>
+#include <cstring>
+
+search_engine::source_util::TermDictionary::TermDictionary() : stripes_(std::make_unique<Stripe[]>(kStripeCount)), arena_mutex_(std::make_unique<pthread_mutex_t>()), arena_chunk_used_(kArenaChunkSize) {
+    for (size_t i = 0; i < kStripeCount; i++) {
+        pthread_mutex_init(&this->stripes_[i].mutex, NULL);
+    }
+    pthread_mutex_init(this->arena_mutex_.get(), NULL);
+}
+
+search_engine::source_util::TermDictionary::~TermDictionary() {
+    if (this->stripes_ == nullptr) {
+        return;
+    }
+    for (size_t i = 0; i < kStripeCount; i++) {
+        pthread_mutex_destroy(&this->stripes_[i].mutex);
+    }
+    pthread_mutex_destroy(this->arena_mutex_.get());
+}
+
+uint32_t search_engine::source_util::TermDictionary::Intern(std::string_view term, size_t hash) {
+    const uint32_t mapped_term_id = this->FindMapped(term, hash);
+    if (mapped_term_id != kNoTerm) {
+        return mapped_term_id;
+    }
+
+    Stripe& stripe = this->stripes_[hash % kStripeCount];
+    pthread_mutex_lock(&stripe.mutex);
+    auto iter = stripe.term_id_map.find(TermKey{.term = term, .hash = hash});
+    if (iter != stripe.term_id_map.end()) {
+        const uint32_t term_id = iter->second;
+        pthread_mutex_unlock(&stripe.mutex);
+        return term_id;
+    }
+
+    pthread_mutex_lock(this->arena_mutex_.get());
+    if (this->arena_chunk_used_ + term.size() > kArenaChunkSize) {
+        this->arena_chunks_.push_back(std::make_unique<char[]>(std::max(term.size(), kArenaChunkSize)));
+        this->arena_chunk_used_ = 0;
+    }
+    char* const term_ptr = this->arena_chunks_.back().get() + this->arena_chunk_used_;
+    memcpy(term_ptr, term.data(), term.size());
+    this->arena_chunk_used_ += term.size();
+    const uint32_t term_id = this->terms_.size();
+    this->terms_.emplace_back(term_ptr, term.size());
+    pthread_mutex_unlock(this->arena_mutex_.get());
+
+    stripe.term_id_map.emplace(TermKey{.term = std::string_view(term_ptr, term.size()), .hash = hash}, term_id);
+    pthread_mutex_unlock(&stripe.mutex);
+    return term_id;
+}
+
+uint32_t search_engine::source_util::TermDictionary::Find(std::string_view term, size_t hash) const {
+    const uint32_t mapped_term_id = this->FindMapped(term, hash);
+    if (mapped_term_id != kNoTerm) {
+        return mapped_term_id;
+    }
+    const Stripe& stripe = this->stripes_[hash % kStripeCount];
+    auto iter = stripe.term_id_map.find(TermKey{.term = term, .hash = hash});
+    return iter == stripe.term_id_map.end() ? kNoTerm : iter->second;
+}
+
+void search_engine::source_util::TermDictionary::Clear() {
+    for (size_t i = 0; i < kStripeCount; i++) {
+        this->stripes_[i].term_id_map.clear();
+    }
+    this->arena_chunks_.clear();
+    this->arena_chunk_used_ = kArenaChunkSize;
+    this->terms_.clear();
+    this->mapped_term_bytes_ = MappableArray<char>();
+    this->mapped_term_offsets_ = MappableArray<uint64_t>();
+    this->mapped_term_hashes_ = MappableArray<uint64_t>();
+    this->mapped_term_slots_ = MappableArray<uint32_t>();
+}
+
+uint32_t search_engine::source_util::TermDictionary::FindMapped(std::string_view term, size_t hash) const {
+    if (this->mapped_term_slots_.empty() == true) {
+        return kNoTerm;
+    }
+    const size_t slot_mask = this->mapped_term_slots_.size() - 1;
+    for (size_t slot = hash & slot_mask;; slot = (slot + 1) & slot_mask) {
+        const uint32_t term_id = this->mapped_term_slots_[slot];
+        if (term_id == kNoTerm) {
+            return kNoTerm;
+        }
+        if (this->mapped_term_hashes_[term_id] == hash && std::string_view(this->mapped_term_bytes_.data() + this->mapped_term_offsets_[term_id], this->mapped_term_offsets_[term_id + 1] - this->mapped_term_offsets_[term_id]) == term) {
+            return term_id;
+        }
+    }
+}
+
+void search_engine::source_util::TermDictionary::Write(IndexFileWriter& writer) const {
+    std::vector<uint64_t> term_hashes(this->terms_.size());
+    std::copy(this->mapped_term_hashes_.begin(), this->mapped_term_hashes_.end(), term_hashes.begin());
+    for (size_t i = 0; i < kStripeCount; i++) {
+        for (auto&& term_id_pair : this->stripes_[i].term_id_map) {
+            term_hashes[term_id_pair.second] = term_id_pair.first.hash;
+        }
+    }
+
+    std::vector<char> term_bytes;
+    std::vector<uint64_t> term_offsets = {0};
+    term_offsets.reserve(this->terms_.size() + 1);
+    for (auto&& term : this->terms_) {
+        term_bytes.insert(term_bytes.end(), term.begin(), term.end());
+        term_offsets.push_back(term_bytes.size());
+    }
+
+    // At most half of the slots are used, which keeps the probe sequences short.
+    size_t slot_count = 2;
+    while (slot_count < this->terms_.size() * 2) {
+        slot_count *= 2;
+    }
+    std::vector<uint32_t> term_slots(slot_count, kNoTerm);
+    for (uint32_t term_id = 0; term_id < this->terms_.size(); term_id++) {
+        size_t slot = term_hashes[term_id] & (slot_count - 1);
+        while (term_slots[slot] != kNoTerm) {
+            slot = (slot + 1) & (slot_count - 1);
+        }
+        term_slots[slot] = term_id;
+    }
+
+    writer.WriteArray(term_bytes);
+    writer.WriteArray(term_offsets);
+    writer.WriteArray(term_hashes);
+    writer.WriteArray(term_slots);
+}
+
+bool search_engine::source_util::TermDictionary::Map(IndexFileReader& reader) {
+    this->Clear();
+    if (reader.ReadArray(this->mapped_term_bytes_) == false || reader.ReadArray(this->mapped_term_offsets_) == false || reader.ReadArray(this->mapped_term_hashes_) == false || reader.ReadArray(this->mapped_term_slots_) == false ||
+        AreValidOffsets(this->mapped_term_offsets_, this->mapped_term_bytes_.size()) == false || this->mapped_term_hashes_.size() + 1 != this->mapped_term_offsets_.size() || this->mapped_term_slots_.size() < 2 * this->mapped_term_hashes_.size() ||
+        (this->mapped_term_slots_.size() & (this->mapped_term_slots_.size() - 1)) != 0) {
+        this->Clear();
+        return false;
+    }
+    // Every slot must be empty or hold a mapped term ID, and at least one must be empty, which ends every probe sequence of FindMapped.
+    size_t empty_slot_count = 0;
+    for (auto&& term_id : this->mapped_term_slots_) {
+        if (term_id == kNoTerm) {
+            empty_slot_count++;
+        } else if (term_id >= this->mapped_term_hashes_.size()) {
+            this->Clear();
+            return false;
+        }
+    }
+    if (empty_slot_count == 0) {
+        this->Clear();
+        return false;
+    }
+    this->terms_.reserve(this->mapped_term_hashes_.size());
+    for (size_t term_id = 0; term_id < this->mapped_term_hashes_.size(); term_id++) {
+        this->terms_.emplace_back(this->mapped_term_bytes_.data() + this->mapped_term_offsets_[term_id], this->mapped_term_offsets_[term_id + 1] - this->mapped_term_offsets_[term_id]);
+    }
+    return true;
+}
\ No newline at end of file
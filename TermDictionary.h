@@ -0,0 +1,118 @@
+#ifndef SEARCH_ENGINE_PROJECT_TERMDICTIONARY_H_
+#define SEARCH_ENGINE_PROJECT_TERMDICTIONARY_H_
+
+#include <pthread.h>
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "IndexFile.h"
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief A cleaned term together with its precomputed hash, so that hash tables keyed by terms never have to hash a term twice.
+ */
+struct TermKey {
+    std::string_view term;
+    size_t hash;
+
+    inline bool operator==(const TermKey& other) const { return this->hash == other.hash && this->term == other.term; }
+};
+
+struct TermKeyHash {
+    inline size_t operator()(const TermKey& key) const { return key.hash; }
+};
+
+/*!
+ * @brief Maps cleaned terms to dense 32-bit term IDs, starting at 0, and back.
+ * @details Terms are compared by their text, so two terms whose hashes collide still get different IDs. The dictionary is split into independently locked stripes by term hash, so parsing threads can intern terms concurrently, and the term strings themselves are copied into large arena chunks that never move once allocated.
+ */
+class TermDictionary {
+   public:
+    // The value returned by Find for a term that is not in the dictionary.
+    static constexpr uint32_t kNoTerm = std::numeric_limits<uint32_t>::max();
+    // Never handed out as a term ID, and stands in a phrase for a word that cannot be indexed, which any word matches.
+    static constexpr uint32_t kAnyTerm = kNoTerm - 1;
+
+    TermDictionary();
+    TermDictionary(TermDictionary&&) = default;
+    TermDictionary& operator=(TermDictionary&&) = default;
+    ~TermDictionary();
+
+    /*!
+     * @brief Returns the term ID of the given term, adding the term to the dictionary first if it is not in it yet. Safe to call from any number of threads.
+     * @param term A term that has already been cleaned by a source_util::Tokenizer.
+     * @param hash The hash of the term, as computed by source_util::Tokenizer.
+     */
+    uint32_t Intern(std::string_view term, size_t hash);
+
+    /*!
+     * @brief Returns the term ID of the given term, or kNoTerm if the term is not in the dictionary.
+     * @param term A term that has already been cleaned by a source_util::Tokenizer.
+     * @param hash The hash of the term, as computed by source_util::Tokenizer.
+     * @warning Must not be called while other threads are interning terms.
+     */
+    uint32_t Find(std::string_view term, size_t hash) const;
+
+    /*!
+     * @brief Returns the text of the term with the given term ID.
+     * @warning Must not be called while other threads are interning terms.
+     */
+    inline std::string_view Term(uint32_t term_id) const { return this->terms_[term_id]; }
+
+    /*!
+     * @brief Returns the amount of terms in the dictionary, which is one more than the largest term ID.
+     * @warning Must not be called while other threads are interning terms.
+     */
+    inline size_t size() const { return this->terms_.size(); }
+
+    void Clear();
+
+    /*!
+     * @brief Writes every term of the dictionary, in term ID order, to the given index file, along with a hash table of their term IDs that Map can look terms up in without building anything.
+     * @warning Must not be called while other threads are interning terms.
+     */
+    void Write(IndexFileWriter& writer) const;
+
+    /*!
+     * @brief Replaces the dictionary with a view of the dictionary that Write wrote next in the given file, which must stay mapped for as long as the dictionary is used. Terms interned afterwards get the term IDs that follow the mapped ones, and are kept in memory.
+     * @return Whether the file held a well-formed dictionary. If not, the dictionary is left empty.
+     */
+    bool Map(IndexFileReader& reader);
+
+   private:
+    static constexpr size_t kStripeCount = 64;
+    static constexpr size_t kArenaChunkSize = 1 << 20;
+
+    struct Stripe {
+        pthread_mutex_t mutex;
+        std::unordered_map<TermKey, uint32_t, TermKeyHash> term_id_map;
+    };
+
+    std::unique_ptr<Stripe[]> stripes_;
+    std::unique_ptr<pthread_mutex_t> arena_mutex_;  // guards everything below
+    std::vector<std::unique_ptr<char[]>> arena_chunks_;
+    size_t arena_chunk_used_;
+    std::vector<std::string_view> terms_;  // term ID -> term
+
+    // Returns the term ID of the given term if it is one of the mapped terms, and kNoTerm otherwise. Only reads the mapped arrays, never terms_, which other threads may be growing.
+    uint32_t FindMapped(std::string_view term, size_t hash) const;
+
+    // Only filled by Map, and never modified afterwards, so they are read without locking.
+    MappableArray<char> mapped_term_bytes_;       // the mapped terms, back to back
+    MappableArray<uint64_t> mapped_term_offsets_;  // mapped term ID -> offset of the term in mapped_term_bytes_, followed by the size of mapped_term_bytes_
+    MappableArray<uint64_t> mapped_term_hashes_;  // mapped term ID -> hash of the term
+    MappableArray<uint32_t> mapped_term_slots_;   // an open-addressing hash table with linear probing, whose size is a power of two, of the mapped term IDs, where empty slots are kNoTerm
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_TERMDICTIONARY_H_
\ No newline at end of file
@@ -0,0 +1,309 @@
+#include "Tokenizer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <immintrin.h>
+#define SEARCH_ENGINE_PROJECT_TOKENIZER_X86_SIMD
+#endif
+
+namespace {
+
+enum ByteClass : uint8_t {
+    kDelimiterByte,
+    kSkippedByte,
+    kInvalidByte,
+    kTokenByte,
+};
+
+struct ByteTable {
+    ByteClass byte_class[256];
+    char folded[256];
+};
+
+constexpr const char* kDelimeters = " \t\v\n\r,.?!;:\"/()";
+
+constexpr ByteTable BuildByteTable() {
+    ByteTable table = {};
+    for (size_t i = 0; i < 256; i++) {
+        table.byte_class[i] = i < 128 ? kTokenByte : kInvalidByte;
+        table.folded[i] = (i >= 'A' && i <= 'Z') ? (char)(i - 'A' + 'a') : (char)i;
+    }
+    for (const char* delimeter = kDelimeters; *delimeter != '\0'; delimeter++) {
+        table.byte_class[(uint8_t)*delimeter] = kDelimiterByte;
+    }
+    table.byte_class[0] = kDelimiterByte;
+    table.byte_class[(uint8_t)'\''] = kSkippedByte;
+    return table;
+}
+
+constexpr ByteTable kByteTable = BuildByteTable();
+
+// Hashes a cleaned term eight bytes at a time. Bytes can also be fed one at a time, which produces the same hash, so a term that has to be cleaned byte by byte hashes exactly like one that is hashed straight out of the buffer.
+class TermHasher {
+   public:
+    inline void Add(uint8_t byte) {
+        this->word_ |= (uint64_t)byte << (8 * (this->size_ & 7));
+        this->size_++;
+        if ((this->size_ & 7) == 0) {
+            this->Mix();
+        }
+    }
+
+    // Must only be called before any single bytes have been added. Each word is loaded in little-endian order, which is the order Add shifts the bytes in, whatever the byte order of the machine.
+    inline void AddWords(const char* data, size_t size) {
+        for (; size >= 8; data += 8, size -= 8) {
+            memcpy(&this->word_, data, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            this->word_ = __builtin_bswap64(this->word_);
+#endif
+            this->size_ += 8;
+            this->Mix();
+        }
+        for (size_t i = 0; i < size; i++) {
+            this->Add(data[i]);
+        }
+    }
+
+    inline size_t Finish() {
+        if ((this->size_ & 7) != 0) {
+            this->Mix();
+        }
+        size_t hash = (this->state_ ^ this->size_) * 0xFF51AFD7ED558CCDULL;
+        return hash ^ (hash >> 29);
+    }
+
+   private:
+    inline void Mix() {
+        this->state_ = (this->state_ ^ this->word_) * 0x9E3779B97F4A7C15ULL;
+        this->state_ ^= this->state_ >> 32;
+        this->word_ = 0;
+    }
+
+    uint64_t state_ = 0x243F6A8885A308D3ULL;
+    uint64_t word_ = 0;
+    size_t size_ = 0;
+};
+
+/*
+ * Each instruction set provides the same ClassifyBlock primitive, which lowercases up to kBlockSize bytes in place and reports, one bit per byte, which of them are delimiters and which need the slow path of Tokenizer::Next (apostrophes and non-ASCII bytes).
+ * Positions past the end of a short block are reported as delimiters, so every token ends inside the block it was found in or at the end of the buffer.
+ */
+
+void ClassifyBlockScalar(char* block, size_t size, uint64_t* delimiter_bits, uint64_t* special_bits) {
+    *delimiter_bits = size < 64 ? ~0ULL << size : 0;
+    *special_bits = 0;
+    for (size_t i = 0; i < size; i++) {
+        const uint8_t byte = block[i];
+        const ByteClass byte_class = kByteTable.byte_class[byte];
+        *delimiter_bits |= (uint64_t)(byte_class == kDelimiterByte) << i;
+        *special_bits |= (uint64_t)(byte_class == kSkippedByte || byte_class == kInvalidByte) << i;
+        block[i] = kByteTable.folded[byte];
+    }
+}
+
+#ifdef SEARCH_ENGINE_PROJECT_TOKENIZER_X86_SIMD
+
+// Every delimiter lies below 0x40, so a byte is a delimiter exactly when the bit for its high nibble is set in the entry for its low nibble.
+struct NibbleTable {
+    uint8_t low[16];
+    uint8_t high[16];
+};
+
+constexpr NibbleTable BuildNibbleTable() {
+    NibbleTable table = {};
+    for (size_t i = 0; i < 0x40; i++) {
+        if (kByteTable.byte_class[i] == kDelimiterByte) {
+            table.low[i & 0x0F] |= (uint8_t)(1 << (i >> 4));
+        }
+    }
+    for (size_t i = 0; i < 4; i++) {
+        table.high[i] = (uint8_t)(1 << i);
+    }
+    return table;
+}
+
+constexpr NibbleTable kNibbleTable = BuildNibbleTable();
+
+void ClassifyBlockSse2(char* block, size_t size, uint64_t* delimiter_bits, uint64_t* special_bits) {
+    if (size < 64) {
+        ClassifyBlockScalar(block, size, delimiter_bits, special_bits);
+        return;
+    }
+    *delimiter_bits = 0;
+    *special_bits = 0;
+    for (size_t i = 0; i < 64; i += 16) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i delimiter_mask = _mm_cmpeq_epi8(chunk, _mm_setzero_si128());
+        for (const char* delimeter = kDelimeters; *delimeter != '\0'; delimeter++) {
+            delimiter_mask = _mm_or_si128(delimiter_mask, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(*delimeter)));
+        }
+        // The sign bit of a byte is set exactly when it is non-ASCII.
+        const uint64_t special = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\''))) | (uint32_t)_mm_movemask_epi8(chunk);
+        *delimiter_bits |= (uint64_t)(uint32_t)_mm_movemask_epi8(delimiter_mask) << i;
+        *special_bits |= special << i;
+
+        const __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(chunk, _mm_set1_epi8('Z' + 1)));
+        _mm_storeu_si128((__m128i*)(block + i), _mm_or_si128(chunk, _mm_and_si128(is_upper, _mm_set1_epi8(0x20))));
+    }
+}
+
+__attribute__((target("avx2"))) void ClassifyBlockAvx2(char* block, size_t size, uint64_t* delimiter_bits, uint64_t* special_bits) {
+    if (size < 64) {
+        ClassifyBlockScalar(block, size, delimiter_bits, special_bits);
+        return;
+    }
+    const __m256i low_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)kNibbleTable.low));
+    const __m256i high_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)kNibbleTable.high));
+    const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+    *delimiter_bits = 0;
+    *special_bits = 0;
+    for (size_t i = 0; i < 64; i += 32) {
+        const __m256i chunk = _mm256_loadu_si256((const __m256i*)(block + i));
+        const __m256i low_bits = _mm256_shuffle_epi8(low_table, _mm256_and_si256(chunk, nibble_mask));
+        const __m256i high_bits = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble_mask));
+        const uint32_t non_delimiter = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(low_bits, high_bits), _mm256_setzero_si256()));
+        const uint64_t special = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\''))) | (uint32_t)_mm256_movemask_epi8(chunk);
+        *delimiter_bits |= (uint64_t)~non_delimiter << i;
+        *special_bits |= special << i;
+
+        const __m256i is_upper = _mm256_and_si256(_mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), chunk));
+        _mm256_storeu_si256((__m256i*)(block + i), _mm256_or_si256(chunk, _mm256_and_si256(is_upper, _mm256_set1_epi8(0x20))));
+    }
+}
+
+#endif  // SEARCH_ENGINE_PROJECT_TOKENIZER_X86_SIMD
+
+using ClassifyBlockFunc = void (*)(char*, size_t, uint64_t*, uint64_t*);
+
+ClassifyBlockFunc SelectClassifyBlock() {
+#ifdef SEARCH_ENGINE_PROJECT_TOKENIZER_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return ClassifyBlockAvx2;
+    }
+    return ClassifyBlockSse2;
+#else
+    return ClassifyBlockScalar;
+#endif
+}
+
+const ClassifyBlockFunc kClassifyBlock = SelectClassifyBlock();
+
+}  // namespace
+
+search_engine::source_util::Tokenizer::Tokenizer(char* text, size_t size) : cursor_(text), end_(text + size), block_(text) {
+    this->LoadBlock();
+}
+
+void search_engine::source_util::Tokenizer::LoadBlock() {
+    if (this->block_ >= this->end_) {
+        this->delimiter_bits_ = ~0ULL;
+        this->special_bits_ = 0;
+        return;
+    }
+    kClassifyBlock(this->block_, std::min<size_t>(this->end_ - this->block_, kBlockSize), &this->delimiter_bits_, &this->special_bits_);
+}
+
+bool search_engine::source_util::Tokenizer::Next(Token& token) {
+    size_t skipped_count = 0;
+    while (true) {
+        while (true) {
+            if (this->cursor_ >= this->end_) {
+                return false;
+            }
+            const size_t offset = this->cursor_ - this->block_;
+            if (offset >= kBlockSize) {
+                this->block_ += kBlockSize;
+                this->LoadBlock();
+                continue;
+            }
+            const uint64_t non_delimiter_bits = ~this->delimiter_bits_ >> offset;
+            if (non_delimiter_bits == 0) {
+                this->cursor_ = this->block_ + kBlockSize;
+                continue;
+            }
+            this->cursor_ += __builtin_ctzll(non_delimiter_bits);
+            break;
+        }
+
+        char* const start = this->cursor_;
+        bool has_special = false;
+        while (true) {
+            size_t offset = this->cursor_ - this->block_;
+            if (offset >= kBlockSize) {
+                this->block_ += kBlockSize;
+                this->LoadBlock();
+                offset = 0;
+            }
+            const uint64_t delimiter_bits = this->delimiter_bits_ >> offset;
+            const size_t run = delimiter_bits != 0 ? __builtin_ctzll(delimiter_bits) : kBlockSize - offset;
+            has_special |= ((this->special_bits_ >> offset) & (run == 64 ? ~0ULL : (1ULL << run) - 1)) != 0;
+            this->cursor_ += run;
+            if (delimiter_bits != 0 || this->cursor_ >= this->end_) {
+                break;
+            }
+        }
+
+        TermHasher hasher;
+        if (has_special == false) {
+            hasher.AddWords(start, this->cursor_ - start);
+            token = {
+                .data = start,
+                .size = (size_t)(this->cursor_ - start),
+                .hash = hasher.Finish(),
+                .skipped_count = skipped_count,
+            };
+            return true;
+        }
+
+        // Slow path: drop the apostrophes in place, and skip the token entirely if it has a non-ASCII byte.
+        char* write_ptr = start;
+        bool is_valid = true;
+        for (const char* it = start; it < this->cursor_; it++) {
+            const ByteClass byte_class = kByteTable.byte_class[(uint8_t)*it];
+            if (byte_class == kTokenByte) {
+                *write_ptr++ = *it;
+                hasher.Add(*it);
+            } else if (byte_class == kInvalidByte) {
+                is_valid = false;
+                break;
+            }
+        }
+        if (is_valid == true && write_ptr != start) {
+            token = {
+                .data = start,
+                .size = (size_t)(write_ptr - start),
+                .hash = hasher.Finish(),
+                .skipped_count = skipped_count,
+            };
+            return true;
+        }
+        skipped_count += is_valid == false ? 1 : 0;
+    }
+}
+
+size_t search_engine::source_util::Tokenizer::HashTerm(const char* term, size_t size, std::string* cleaned_term) {
+    TermHasher hasher;
+    size_t cleaned_size = 0;
+    if (cleaned_term != nullptr) {
+        cleaned_term->clear();
+    }
+    for (size_t i = 0; i < size; i++) {
+        const uint8_t byte = term[i];
+        const ByteClass byte_class = kByteTable.byte_class[byte];
+        if (byte_class == kInvalidByte) {
+            return kInvalidHash;
+        }
+        if (byte_class == kSkippedByte) {
+            continue;
+        }
+        hasher.Add(kByteTable.folded[byte]);
+        cleaned_size++;
+        if (cleaned_term != nullptr) {
+            cleaned_term->push_back(kByteTable.folded[byte]);
+        }
+    }
+    return cleaned_size == 0 ? kInvalidHash : hasher.Finish();
+}
\ No newline at end of file
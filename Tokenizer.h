@@ -0,0 +1,66 @@
+#ifndef SEARCH_ENGINE_PROJECT_TOKENIZER_H_
+#define SEARCH_ENGINE_PROJECT_TOKENIZER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace search_engine {
+
+namespace source_util {
+
+/*!
+ * @brief A single-pass, allocation-free tokenizer that splits a mutable character buffer into value tokens.
+ * @details The buffer is classified 64 bytes at a time with SSE2 or AVX2 (picked at run time, with a scalar fallback built on a 256-entry lookup table), which lowercases the bytes and yields bitmasks of the delimiters, apostrophes and non-ASCII bytes. Token boundaries are then found by scanning those bitmasks, apostrophes are stripped in place, and each token is hashed a word at a time as soon as its end is known, so neither the tokenizer nor HashTerm ever allocates. A token that contains a non-ASCII byte is skipped entirely, but counted, so that positions can still account for it.
+ * @warning The buffer handed to the constructor is modified while it is being tokenized, and the tokens returned by Next point into it.
+ */
+class Tokenizer {
+   public:
+    struct Token {
+        const char* data;  // the lowercased, apostrophe-free token, which is not null terminated
+        size_t size;
+        size_t hash;  // equal to HashTerm(data, size)
+        size_t skipped_count;  // the tokens right before this one that were skipped because they contain a non-ASCII byte, which still take up a position of their own
+    };
+
+    // The value returned by HashTerm for a term that cannot be indexed.
+    static constexpr size_t kInvalidHash = std::string::npos;
+
+    /*!
+     * @param text The buffer to tokenize. It does not need to be null terminated.
+     * @param size The amount of bytes in the buffer.
+     */
+    Tokenizer(char* text, size_t size);
+
+    /*!
+     * @brief Advances to the next valid token in the buffer.
+     * @param token Filled with the next token if there is one.
+     * @return False once the end of the buffer has been reached.
+     */
+    bool Next(Token& token);
+
+    /*!
+     * @brief Cleans and hashes the given term exactly like Next would, without modifying the term itself. Delimiter bytes inside the term are kept and hashed like any other byte.
+     * @param cleaned_term If not null, receives the cleaned term.
+     * @return The hash of the cleaned term, or kInvalidHash if the term contains a non-ASCII byte or is empty once cleaned.
+     */
+    static size_t HashTerm(const char* term, size_t size, std::string* cleaned_term = nullptr);
+
+   private:
+    // The amount of bytes classified at once. Each block is described by one bit per byte in delimiter_bits_ and special_bits_.
+    static constexpr size_t kBlockSize = 64;
+
+    // Lowercases the block starting at block_ and fills delimiter_bits_ and special_bits_ for it, using the widest vector instructions the CPU supports.
+    void LoadBlock();
+
+    char* cursor_;
+    char* const end_;
+    char* block_;
+    uint64_t delimiter_bits_;
+    uint64_t special_bits_;  // apostrophes and non-ASCII bytes
+};
+
+}  // namespace source_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_TOKENIZER_H_
\ No newline at end of file
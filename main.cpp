@@ -1,21 +1,167 @@
 #include <boost/program_options.hpp>
+#include <malloc.h>
+
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
 
 #include "KaggleFinanceSourceEngine.h"
 #include "SearchEngine.h"
 
+/*!
+ * @brief Parses the sources at the given path with a KaggleFinanceEngine that uses the given container policy, or loads them from the given index file if it exists, and then acts on every other flag in vm.
+ * @param index_path The index file to load the database from, or to write it to once the sources are parsed if it does not exist yet. Empty if no index file is used.
+ * @param update_index Whether a database loaded from index_path is brought up to date with the sources at the given path, and written back to index_path.
+ */
+template <typename ContainerPolicy>
+int RunEngine(const boost::program_options::variables_map& vm, const std::string& path, const std::string& index_path, bool update_index, int64_t parser_thread_count, int64_t filler_thread_count, const std::string& ranking, const std::string& merges,
+              bool record_positions) {
+    using SearchEngine = search_engine::SearchEngine<uint32_t, uint32_t, std::string, ContainerPolicy>;
+    typename SearchEngine::RankingMode ranking_mode;
+    if (ranking == "cascade") {
+        ranking_mode = SearchEngine::RankingMode::kCascade;
+    } else if (ranking == "bm25") {
+        ranking_mode = SearchEngine::RankingMode::kBm25;
+    } else {
+        std::cerr << "Unknown ranking: " << ranking << ". Please use cascade or bm25." << std::endl;
+        return 1;
+    }
+    std::optional<search_engine::source_util::TieredMergePolicy> merge_policy;
+    if (merges == "tiered") {
+        merge_policy = search_engine::source_util::TieredMergePolicy();
+    } else if (merges != "none") {
+        std::cerr << "Unknown merges: " << merges << ". Please use tiered or none." << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<search_engine::KaggleFinanceEngine<ContainerPolicy>> source_engine_ptr = std::make_unique<search_engine::KaggleFinanceEngine<ContainerPolicy>>(parser_thread_count, filler_thread_count, record_positions, merge_policy);
+    const bool load_index = index_path.empty() == false && std::filesystem::exists(index_path) == true;
+    update_index = update_index == true && load_index == true;
+    if (load_index == true) {
+        if (source_engine_ptr->LoadIndex(index_path) == false) {
+            return 1;
+        }
+    }
+    if (load_index == false || update_index == true) {
+        source_engine_ptr->ParseSources(path);
+        // The merges are written to the index file too, rather than being done again by every run that loads it.
+        if (index_path.empty() == false) {
+            source_engine_ptr->WaitForMerges();
+        }
+        if (index_path.empty() == false && source_engine_ptr->SaveIndex(index_path) == false) {
+            return 1;
+        }
+    }
+    const search_engine::KaggleFinanceEngine<ContainerPolicy> &source_engine = *source_engine_ptr;
+    const typename search_engine::KaggleFinanceEngine<ContainerPolicy>::Database *const database_ptr = source_engine.GetRuntimeDatabase();
+    SearchEngine search_engine(std::move(source_engine_ptr), ranking_mode);
+
+    if (vm.count("ingest-stats")) {
+        const auto& change_stats = source_engine.GetSourceChangeStats();
+        std::cout << "sources: " << change_stats.new_count << " new, " << change_stats.changed_count << " changed, " << change_stats.removed_count << " removed, " << change_stats.unchanged_count << " unchanged" << std::endl;
+        const auto& merge_stats = source_engine.GetMergeStats();
+        std::cout << "merges: " << merge_stats.merge_count << ", " << merge_stats.merged_document_count << " documents written, " << merge_stats.dropped_document_count << " deleted documents dropped, " << merge_stats.seconds << " s" << std::endl;
+        const auto& stats_vec = source_engine.GetParsingThreadStats();
+        double max_seconds = 0;
+        double total_seconds = 0;
+        for (size_t i = 0; i < stats_vec.size(); i++) {
+            std::cout << "parser " << i << ": " << stats_vec[i].file_count << " files, " << stats_vec[i].byte_count << " bytes, " << stats_vec[i].batch_count << " batches, " << stats_vec[i].seconds << " s" << std::endl;
+            max_seconds = std::max(max_seconds, stats_vec[i].seconds);
+            total_seconds += stats_vec[i].seconds;
+        }
+        if (total_seconds > 0) {
+            std::cout << "parser imbalance (slowest / mean - 1): " << (max_seconds / (total_seconds / stats_vec.size()) - 1) * 100 << "%" << std::endl;
+        }
+    }
+    if (vm.count("memory-report")) {
+        std::cout << "segments: " << database_ptr->segments.size() << ", deleted documents: " << database_ptr->document_table.deleted_count() << std::endl;
+    }
+    if (vm.count("memory-report") && load_index == true && update_index == false) {
+        const auto& load_stats = source_engine.GetLoadStats();
+        size_t posting_count = 0;
+        for (auto&& segment : database_ptr->segments) {
+            posting_count += segment.value_postings.posting_count() + segment.title_postings.posting_count();
+        }
+        std::cout << "postings: " << posting_count << std::endl;
+        std::cout << "mapped index file: " << load_stats.file_byte_count << " bytes" << std::endl;
+        std::cout << "load: " << load_stats.seconds << " s" << std::endl;
+        std::cout << "steady-state rss: " << load_stats.steady_rss_byte_count / (1 << 20) << " MiB" << std::endl;
+    } else if (vm.count("memory-report")) {
+        // Only the segment that was just parsed is covered, which is every segment unless the database was updated.
+        const auto& memory_stats = source_engine.GetPostingMemoryStats();
+        std::cout << "postings: " << memory_stats.posting_count << std::endl;
+        std::cout << "hash map postings: " << memory_stats.hash_map_byte_count << " bytes (~" << (double)memory_stats.hash_map_byte_count / std::max<size_t>(memory_stats.posting_count, 1) << " bytes per posting)" << std::endl;
+        std::cout << "compressed postings: " << memory_stats.compressed_byte_count << " bytes (" << (double)memory_stats.compressed_byte_count / std::max<size_t>(memory_stats.posting_count, 1) << " bytes per posting)" << std::endl;
+        std::cout << "block-max metadata: " << memory_stats.block_max_byte_count << " bytes" << std::endl;
+        if (record_positions == true) {
+            std::cout << "compressed positions: " << memory_stats.position_byte_count << " bytes (" << (double)memory_stats.position_byte_count / std::max<size_t>(memory_stats.posting_count, 1) << " bytes per posting)" << std::endl;
+        }
+        const auto& freeze_stats = source_engine.GetFreezeStats();
+        std::cout << "freeze: " << freeze_stats.seconds << " s" << std::endl;
+        std::cout << "peak rss: " << freeze_stats.peak_rss_byte_count / (1 << 20) << " MiB, steady-state rss: " << freeze_stats.steady_rss_byte_count / (1 << 20) << " MiB" << std::endl;
+    }
+    if (vm.count("print-database")) {
+        for (size_t i = 0; i < database_ptr->segments.size(); i++) {
+            const auto& segment = database_ptr->segments[i];
+            std::cout << "segment " << i << " value_postings: " << std::endl;
+            for (size_t ordinal = 0; ordinal < segment.value_postings.size(); ordinal++) {
+                if (segment.value_postings[ordinal].empty() == true) {
+                    continue;
+                }
+                std::cout << database_ptr->term_dictionary.Term(segment.term_ids[ordinal]) << " -> " << std::endl;
+                for (auto&& pair2 : segment.value_postings[ordinal]) {
+                    std::cout << "\t" << pair2.first << " -> " << pair2.second << std::endl;
+                }
+            }
+        }
+    }
+    if (vm.count("search")) {
+        std::string query;
+        std::cout << "Enter a query: ";
+        std::getline(std::cin, query);
+        std::cout << "Results for query: " << query << std::endl;
+        std::optional<size_t> result_count = std::nullopt;
+        if (vm.count("top-k")) {
+            result_count = vm["top-k"].as<size_t>();
+        }
+        std::vector<std::string> results = search_engine.HandleQuery(query, result_count);
+        for (auto&& result : results) {
+            std::cout << "\t" << result << std::endl;
+        }
+    }
+    if (vm.count("ui")) {
+        search_engine.InitCommandLineInterface();
+    }
+    return 0;
+}
+
 int main(int argc, char** argv) {
+    // Each time a large buffer, such as a position buffer of a parsing thread, outgrows its mmapped block and frees it, glibc raises its mmap and trim thresholds to that block's size, after which the tops of the parsing threads' arenas stay resident, out of the reach of the malloc_trim that ends every parse. Setting the threshold explicitly, to its default, turns that adjustment off for the whole process, which is why it is done here rather than by the engine.
+    mallopt(M_MMAP_THRESHOLD, 128 * 1024);
     std::string path;
+    std::string index_path;
     int64_t parser_thread_count;
     int64_t filler_thread_count;
+    std::string containers;
+    std::string ranking;
+    std::string merges;
     try {
         boost::program_options::options_description desc("Options");
         desc.add_options()
             /* help flag   */ ("help", "Help screen")
             /* path flag   */ ("path", boost::program_options::value<std::string>(&path)->default_value("../sample_kaggle_finance_data"), "Sets the path to the file or folder of files you wish to parse.")
+            /* index flag  */ ("index,i", boost::program_options::value<std::string>(&index_path), "Loads the database from the given index file instead of parsing the sources, or, if the file does not exist yet, parses the sources and then writes the database to it. A loaded database holds positions if, and only if, the one written did.")
             /* thread flag */ ("parser-threads,pt", boost::program_options::value<int64_t>(&parser_thread_count)->default_value(1), "Sets the number of threads to be used to parse the given file or folder of files.")
             /* thread flag */ ("filler-threads,ft", boost::program_options::value<int64_t>(&filler_thread_count)->default_value(1), "Sets the number of threads to be used to fill the database while parsing the given file or folder of files.")
+            /* containers  */ ("containers,c", boost::program_options::value<std::string>(&containers)->default_value("std"), "Sets the containers of the run-time database: std (node-based hash maps), flat (open-addressing hash maps), or compact (flat hash maps while parsing, sorted vectors once parsed).")
+            /* positions   */ ("positions,pos", "Records the position of every value and title token, which lets quoted values and title terms match exact phrases rather than every source that holds all of their words.")
+            /* ranking     */ ("ranking,r", boost::program_options::value<std::string>(&ranking)->default_value("cascade"), "Sets how query results are ranked: cascade (metadata flags, then raw title and value counts) or bm25 (metadata flags, then the BM25 score of the values and title terms).")
+            /* merges      */ ("merges,m", boost::program_options::value<std::string>(&merges)->default_value("tiered"), "Sets how the segments that the update flag adds are merged: tiered (neighbouring segments of similar sizes are merged in the background, and the merges are written to the index file) or none.")
+            /* stats flag  */ ("ingest-stats,is", "Prints the per-thread load of the parsing threads and their imbalance after parsing the given file or folder of files.")
+            /* memory flag */ ("memory-report,mr", "Prints how much memory the value and title postings took before and after they were compressed, and the peak and steady-state resident memory of the process.")
+            /* update flag */ ("update,u", "With the index flag, brings the database loaded from the index file up to date with the given file or folder of files, by only parsing the sources that were added or changed since and deleting the ones that were removed, and then writes it back to the index file.")
             /* print flag  */ ("print-database,pd", "Prints the contents of the database after completely parsing the given file or folder of files.")
+            /* top-k flag  */ ("top-k,k", boost::program_options::value<size_t>(), "Limits the search flag to the given amount of best ranked results.")
             /* search flag */ ("search,s", "Prompts the user to enter a query and then searches the database for the given query.")
             /* ui flag     */ ("ui", "Initializes the command line interface for the search engine.");
 
@@ -27,35 +173,15 @@ int main(int argc, char** argv) {
             return 1;
         }
 
-        search_engine::KaggleFinanceEngine source_engine(parser_thread_count, filler_thread_count);
-        source_engine.ParseSources(path);
-        const search_engine::source_util::RunTimeDatabase<size_t, size_t, std::string> *const database_ptr = source_engine.GetRuntimeDatabase();
-        search_engine::SearchEngine<size_t, size_t, std::string> search_engine(std::make_unique<search_engine::KaggleFinanceEngine>(source_engine));
-
-        if (vm.count("print-database")) {
-            std::cout << "value_index: " << std::endl;
-            for (auto&& map : database_ptr->value_index) {
-                for (auto&& pair : map) {
-                    std::cout << pair.first << " -> " << std::endl;
-                    for (auto&& pair2 : pair.second) {
-                        std::cout << "\t" << pair2.first << " -> " << pair2.second << std::endl;
-                    }
-                }
-            }
-        }
-        if (vm.count("search")) {
-            std::string query;
-            std::cout << "Enter a query: ";
-            std::getline(std::cin, query);
-            std::cout << "Results for query: " << query << std::endl;
-            std::vector<std::string> results = search_engine.HandleQuery(query);
-            for (auto&& result : results) {
-                std::cout << "\t" << result << std::endl;
-            }
-        }
-        if (vm.count("ui")) {
-            search_engine.InitCommandLineInterface();
+        if (containers == "std") {
+            return RunEngine<search_engine::source_util::StdContainerPolicy>(vm, path, index_path, vm.count("update") > 0, parser_thread_count, filler_thread_count, ranking, merges, vm.count("positions") > 0);
+        } else if (containers == "flat") {
+            return RunEngine<search_engine::source_util::FlatContainerPolicy>(vm, path, index_path, vm.count("update") > 0, parser_thread_count, filler_thread_count, ranking, merges, vm.count("positions") > 0);
+        } else if (containers == "compact") {
+            return RunEngine<search_engine::source_util::CompactContainerPolicy>(vm, path, index_path, vm.count("update") > 0, parser_thread_count, filler_thread_count, ranking, merges, vm.count("positions") > 0);
         }
+        std::cerr << "Unknown containers: " << containers << ". Please use std, flat, or compact." << std::endl;
+        return 1;
     } catch (const boost::program_options::error& ex) {
         std::cerr << ex.what() << '\n';
     }
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <vector>
+
+#include "../IndexFile.h"
+#include "../PositionIndex.h"
+#include "../PostingList.h"
+#include "../TermDictionary.h"
+#include "TestUtil.h"
+
+namespace {
+
+using search_engine::source_util::IndexFileReader;
+using search_engine::source_util::IndexFileWriter;
+using search_engine::source_util::MappedIndexFile;
+
+/*!
+ * @brief Writes index files by hand, array by array, so that every way an array can be malformed can be written as is and mapped back.
+ */
+class IndexFileTest : public ::testing::Test {
+   protected:
+    IndexFileTest() : corpus_("index-file"), index_path_(corpus_.path() + "/test.idx") {}
+
+    // Writes a posting count, encoded bytes and offsets, in the layout PostingIndex::Write uses, and maps them back into a PostingIndex.
+    bool MapPostingIndex(const std::vector<uint8_t>& bytes, const std::vector<size_t>& offsets) {
+        IndexFileWriter writer(this->index_path_);
+        writer.WriteValue(0);
+        writer.WriteArray(bytes);
+        writer.WriteArray(offsets);
+        EXPECT_TRUE(writer.Close());
+        MappedIndexFile file;
+        EXPECT_TRUE(file.Open(this->index_path_));
+        IndexFileReader reader(file);
+        search_engine::source_util::PostingIndex<uint32_t> index;
+        return index.Map(reader);
+    }
+
+    // Writes encoded bytes and offsets, in the layout PositionIndex::Write uses, and maps them back into a PositionIndex.
+    bool MapPositionIndex(const std::vector<uint8_t>& bytes, const std::vector<size_t>& offsets) {
+        IndexFileWriter writer(this->index_path_);
+        writer.WriteArray(bytes);
+        writer.WriteArray(offsets);
+        EXPECT_TRUE(writer.Close());
+        MappedIndexFile file;
+        EXPECT_TRUE(file.Open(this->index_path_));
+        IndexFileReader reader(file);
+        search_engine::source_util::PositionIndex<uint32_t> index;
+        return index.Map(reader);
+    }
+
+    search_engine::test_util::TestCorpus corpus_;
+    std::string index_path_;
+};
+
+TEST_F(IndexFileTest, CloseReplacesTheDestinationWithoutLeavingTheTemporaryFile) {
+    for (uint64_t value : {1, 2}) {
+        IndexFileWriter writer(this->index_path_);
+        writer.WriteValue(value);
+        ASSERT_TRUE(writer.Close());
+    }
+    EXPECT_FALSE(std::filesystem::exists(this->index_path_ + ".tmp"));
+    MappedIndexFile file;
+    ASSERT_TRUE(file.Open(this->index_path_));
+    IndexFileReader reader(file);
+    uint64_t value = 0;
+    ASSERT_TRUE(reader.ReadValue(value));
+    EXPECT_EQ(value, 2);
+}
+
+TEST_F(IndexFileTest, PostingIndexMapsWellFormedOffsets) {
+    // Two lists of one posting each, {1, 1} and {2, 300}, and an empty list between them.
+    EXPECT_TRUE(this->MapPostingIndex({1, 1, 1, 1, 2, 0xac, 0x02}, {0, 3, 3, 7}));
+}
+
+TEST_F(IndexFileTest, PostingIndexRejectsMalformedOffsets) {
+    const std::vector<uint8_t> bytes = {1, 1, 1, 1, 2, 0xac, 0x02};
+    EXPECT_FALSE(this->MapPostingIndex(bytes, {}));  // no offsets at all
+    EXPECT_FALSE(this->MapPostingIndex(bytes, {1, 3, 7}));  // does not start at 0
+    EXPECT_FALSE(this->MapPostingIndex(bytes, {0, 5, 3, 7}));  // decreases
+    EXPECT_FALSE(this->MapPostingIndex(bytes, {0, 3, 6}));  // does not end at the end of the bytes
+    EXPECT_FALSE(this->MapPostingIndex(bytes, {0, 3, 100, 7}));  // points past the end of the bytes
+    EXPECT_FALSE(this->MapPostingIndex(bytes, {0, 6, 7}));  // a list ends in the middle of a varint
+    EXPECT_FALSE(this->MapPostingIndex({1, 1, 0x81}, {0, 3}));  // the last list ends in the middle of a varint
+}
+
+TEST_F(IndexFileTest, PositionIndexRejectsMalformedOffsets) {
+    const std::vector<uint8_t> bytes = {1, 0, 2, 0x81, 0x01};
+    EXPECT_TRUE(this->MapPositionIndex(bytes, {0, 2, 5}));
+    EXPECT_FALSE(this->MapPositionIndex(bytes, {0, 6, 5}));
+    EXPECT_FALSE(this->MapPositionIndex(bytes, {0, 4, 5}));
+}
+
+TEST_F(IndexFileTest, TermDictionaryRejectsSlotsOutsideItsTerms) {
+    auto map_dictionary = [this](const std::vector<uint32_t>& slots) {
+        IndexFileWriter writer(this->index_path_);
+        writer.WriteArray(std::vector<char>{'a', 'b', 'c'});
+        writer.WriteArray(std::vector<uint64_t>{0, 3});
+        writer.WriteArray(std::vector<uint64_t>{0});
+        writer.WriteArray(slots);
+        EXPECT_TRUE(writer.Close());
+        MappedIndexFile file;
+        EXPECT_TRUE(file.Open(this->index_path_));
+        IndexFileReader reader(file);
+        search_engine::source_util::TermDictionary dictionary;
+        return dictionary.Map(reader);
+    };
+    EXPECT_TRUE(map_dictionary({0, search_engine::source_util::TermDictionary::kNoTerm}));
+    EXPECT_FALSE(map_dictionary({0, 7}));
+    EXPECT_FALSE(map_dictionary({0, 0}));
+}
+
+}  // namespace
\ No newline at end of file
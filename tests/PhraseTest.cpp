@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "../KaggleFinanceSourceEngine.h"
+#include "../SearchEngine.h"
+#include "../Tokenizer.h"
+#include "TestUtil.h"
+
+namespace {
+
+using Engine = search_engine::KaggleFinanceEngine<search_engine::source_util::CompactContainerPolicy>;
+using SearchEngine = search_engine::SearchEngine<uint32_t, uint32_t, std::string, search_engine::source_util::CompactContainerPolicy>;
+
+// A word with a curly apostrophe, which cannot be indexed, as it is common in the articles of the corpus.
+const std::string kCurlyWord = "Germany\xe2\x80\x99s";
+
+/*!
+ * @brief Indexes, with positions, one article whose words are next to each other, and one where a word that cannot be indexed sits between the same words.
+ */
+class PhraseTest : public ::testing::Test {
+   protected:
+    PhraseTest() : corpus_("phrase") {
+        this->corpus_.WriteArticle("adjacent.json", "exports rise", "a survey by DIHK shows growth");
+        this->corpus_.WriteArticle("separated.json", "exports " + kCurlyWord + " rise", "a survey by " + kCurlyWord + " DIHK shows growth");
+        std::unique_ptr<Engine> engine_ptr = std::make_unique<Engine>(1, 1, true);
+        engine_ptr->ParseSources(this->corpus_.path());
+        this->engine_ = engine_ptr.get();
+        this->search_engine_ = std::make_unique<SearchEngine>(std::move(engine_ptr), SearchEngine::RankingMode::kBm25);
+    }
+
+    // The file names of the sources that answer the given query, sorted.
+    std::vector<std::string> Answer(const search_engine::Query& query) {
+        std::vector<std::string> file_names;
+        for (auto&& path : this->search_engine_->HandleQuery(query, std::nullopt)) {
+            file_names.push_back(std::filesystem::path(path).filename().string());
+        }
+        std::sort(file_names.begin(), file_names.end());
+        return file_names;
+    }
+
+    search_engine::test_util::TestCorpus corpus_;
+    Engine* engine_;
+    std::unique_ptr<SearchEngine> search_engine_;
+};
+
+TEST_F(PhraseTest, TokenizerCountsTheTokensItSkips) {
+    std::string text = "by " + kCurlyWord + " " + kCurlyWord + " dihk";
+    search_engine::source_util::Tokenizer tokenizer(text.data(), text.size());
+    search_engine::source_util::Tokenizer::Token token;
+    ASSERT_TRUE(tokenizer.Next(token));
+    EXPECT_EQ(std::string(token.data, token.size), "by");
+    EXPECT_EQ(token.skipped_count, 0);
+    ASSERT_TRUE(tokenizer.Next(token));
+    EXPECT_EQ(std::string(token.data, token.size), "dihk");
+    EXPECT_EQ(token.skipped_count, 2);
+    EXPECT_FALSE(tokenizer.Next(token));
+}
+
+TEST_F(PhraseTest, PhraseDoesNotMatchAcrossAWordThatCannotBeIndexed) {
+    EXPECT_EQ(this->Answer(search_engine::QueryParser::Parse("values: \"by dihk\"")), std::vector<std::string>{"adjacent.json"});
+    EXPECT_EQ(this->Answer(search_engine::QueryParser::Parse("title: \"exports rise\"")), std::vector<std::string>{"adjacent.json"});
+    // The skipped words still do not count toward the BM25 length of a field.
+    for (uint32_t document_id = 0; document_id < 2; document_id++) {
+        EXPECT_EQ(this->engine_->GetRuntimeDatabase()->value_lengths.lengths[document_id], 6);
+        EXPECT_EQ(this->engine_->GetRuntimeDatabase()->title_lengths.lengths[document_id], 2);
+    }
+}
+
+TEST_F(PhraseTest, WordThatCannotBeIndexedKeepsItsPlaceInAPhrase) {
+    const search_engine::Query query = search_engine::QueryParser::Parse("values: \"by " + kCurlyWord + " dihk\"");
+    EXPECT_EQ(query.warnings.size(), 1);
+    EXPECT_EQ(this->Answer(query), std::vector<std::string>{"separated.json"});
+    // A slop of one lets the gap close up again.
+    EXPECT_EQ(this->Answer(search_engine::QueryParser::Parse("values: \"by dihk\"~1")), (std::vector<std::string>{"adjacent.json", "separated.json"}));
+    EXPECT_EQ(this->Answer(search_engine::QueryParser::Parse("values: \"survey " + kCurlyWord + " shows\"")), std::vector<std::string>{});
+    EXPECT_EQ(this->Answer(search_engine::QueryParser::Parse("title: \"exports " + kCurlyWord + " rise\"")), std::vector<std::string>{"separated.json"});
+}
+
+}  // namespace
\ No newline at end of file
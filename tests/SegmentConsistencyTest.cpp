@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+
+#include "../KaggleFinanceSourceEngine.h"
+#include "../SearchEngine.h"
+#include "TestUtil.h"
+
+namespace {
+
+using Engine = search_engine::KaggleFinanceEngine<search_engine::source_util::CompactContainerPolicy>;
+using SearchEngine = search_engine::SearchEngine<uint32_t, uint32_t, std::string, search_engine::source_util::CompactContainerPolicy>;
+
+// The amount of queries that every segment count is compared and timed on, spread evenly over the term IDs.
+constexpr size_t kQueryCount = 1000;
+constexpr size_t kFolderCount = 8;
+// The sources that are rewritten in one folder, and removed from another, by DeleteSources.
+constexpr size_t kDeletedCount = 30;
+
+class SegmentConsistencyTest : public ::testing::Test {
+   protected:
+    SegmentConsistencyTest() : corpus_("segments") {
+        for (uint32_t i = 0; i < kFolderCount; i++) {
+            this->corpus_.WriteFolder("folder_" + std::to_string(i), 150, i);
+        }
+    }
+
+    // Parses every folder of the corpus into a segment of its own, in order.
+    std::unique_ptr<Engine> ParseFolders(std::optional<search_engine::source_util::TieredMergePolicy> merge_policy) {
+        std::unique_ptr<Engine> engine_ptr = std::make_unique<Engine>(2, 2, true, merge_policy);
+        for (size_t i = 0; i < kFolderCount; i++) {
+            engine_ptr->ParseSources(this->corpus_.FolderPath("folder_" + std::to_string(i)));
+        }
+        return engine_ptr;
+    }
+
+    // Rewrites and removes some of the sources of two folders, and updates the given engine with them, which leaves deleted documents in the segments of both folders and adds a segment of the rewritten sources.
+    void DeleteSources(Engine& engine) {
+        for (size_t i = 0; i < kDeletedCount; i++) {
+            this->corpus_.RewriteArticle("folder_1/article_" + std::to_string(i) + ".json", 1000 + i);
+            this->corpus_.Remove("folder_6/article_" + std::to_string(i) + ".json");
+        }
+        engine.ParseSources(this->corpus_.FolderPath("folder_1"));
+        engine.ParseSources(this->corpus_.FolderPath("folder_6"));
+    }
+
+    // Merges the segments down to fewer and fewer of them, checks that every segment count answers the queries as the first one did, and prints how long a query takes at every segment count, which is what each segment costs a query.
+    void ExpectSameAnswersAtEverySegmentCount(SearchEngine::RankingMode ranking_mode, bool with_deleted_sources) {
+        std::unique_ptr<Engine> engine_ptr = this->ParseFolders(std::nullopt);
+        Engine* const engine = engine_ptr.get();
+        const Engine::Database* const database_ptr = engine->GetRuntimeDatabase();
+        if (with_deleted_sources == true) {
+            this->DeleteSources(*engine);
+            ASSERT_EQ(database_ptr->document_table.deleted_count(), 2 * kDeletedCount);
+        }
+        const std::vector<search_engine::Query> queries = search_engine::test_util::SampleQueries(*database_ptr, kQueryCount);
+        SearchEngine search_engine(std::move(engine_ptr), ranking_mode);
+        const auto first_answers = search_engine::test_util::Answer(search_engine, queries);
+        const auto first_top_answers = search_engine::test_util::Answer(search_engine, queries, 10);
+        while (true) {
+            SCOPED_TRACE(std::to_string(database_ptr->segments.size()) + " segment(s)");
+            EXPECT_EQ(search_engine::test_util::Answer(search_engine, queries), first_answers);
+            const auto start_time = std::chrono::steady_clock::now();
+            EXPECT_EQ(search_engine::test_util::Answer(search_engine, queries, 10), first_top_answers);
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+            std::cout << (ranking_mode == SearchEngine::RankingMode::kBm25 ? "bm25" : "cascade") << ", " << database_ptr->segments.size() << " segment(s): " << seconds * 1000 / queries.size() << " ms per top-10 query" << std::endl;
+            if (database_ptr->segments.size() <= 1) {
+                break;
+            }
+            engine->ForceMerge(database_ptr->segments.size() / 2);
+        }
+        EXPECT_EQ(database_ptr->segments.front().document_count, database_ptr->document_table.size() - database_ptr->document_table.deleted_count());
+    }
+
+    search_engine::test_util::TestCorpus corpus_;
+};
+
+TEST_F(SegmentConsistencyTest, AnswersDoNotDependOnTheSegmentCount) {
+    for (auto ranking_mode : {SearchEngine::RankingMode::kCascade, SearchEngine::RankingMode::kBm25}) {
+        this->ExpectSameAnswersAtEverySegmentCount(ranking_mode, false);
+    }
+}
+
+// Each ranking mode gets a test of its own, since DeleteSources changes the corpus. A merge drops the postings of the deleted documents, which must not change the BM25 statistics of any term.
+TEST_F(SegmentConsistencyTest, CascadeAnswersWithDeletedSourcesDoNotDependOnTheSegmentCount) { this->ExpectSameAnswersAtEverySegmentCount(SearchEngine::RankingMode::kCascade, true); }
+TEST_F(SegmentConsistencyTest, Bm25AnswersWithDeletedSourcesDoNotDependOnTheSegmentCount) { this->ExpectSameAnswersAtEverySegmentCount(SearchEngine::RankingMode::kBm25, true); }
+
+TEST_F(SegmentConsistencyTest, BackgroundMergesKeepTheAnswers) {
+    std::unique_ptr<Engine> engine_ptr = this->ParseFolders(search_engine::source_util::TieredMergePolicy{.segments_per_tier = 4, .floor_live_count = 10, .max_deleted_fraction = 0.25});
+    engine_ptr->WaitForMerges();
+    EXPECT_LT(engine_ptr->GetRuntimeDatabase()->segments.size(), kFolderCount);
+    EXPECT_GT(engine_ptr->GetMergeStats().merge_count, 0);
+    std::unique_ptr<Engine> reference_engine_ptr = this->ParseFolders(std::nullopt);
+    ASSERT_EQ(reference_engine_ptr->GetRuntimeDatabase()->segments.size(), kFolderCount);
+    const std::vector<search_engine::Query> queries = search_engine::test_util::SampleQueries(*reference_engine_ptr->GetRuntimeDatabase(), kQueryCount);
+    SearchEngine search_engine(std::move(engine_ptr), SearchEngine::RankingMode::kBm25);
+    SearchEngine reference_search_engine(std::move(reference_engine_ptr), SearchEngine::RankingMode::kBm25);
+    EXPECT_EQ(search_engine::test_util::Answer(search_engine, queries), search_engine::test_util::Answer(reference_search_engine, queries));
+    EXPECT_EQ(search_engine::test_util::Answer(search_engine, queries, 10), search_engine::test_util::Answer(reference_search_engine, queries, 10));
+}
+
+}  // namespace
\ No newline at end of file
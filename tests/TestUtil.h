@@ -0,0 +1,196 @@
+#ifndef SEARCH_ENGINE_PROJECT_TESTS_TESTUTIL_H_
+#define SEARCH_ENGINE_PROJECT_TESTS_TESTUTIL_H_
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../QueryParser.h"
+#include "../SourceEngine.h"
+
+namespace search_engine {
+
+namespace test_util {
+
+/*!
+ * @brief A folder of generated Kaggle finance articles in the temporary directory, which is removed again when the corpus is destroyed.
+ * @details The words of the articles are drawn from a vocabulary of made-up words with a roughly Zipfian distribution, so that the postings range from a handful of documents to nearly all of them, like the postings of real articles do. The same seed always generates the same articles.
+ */
+class TestCorpus {
+   public:
+    explicit TestCorpus(const std::string& name) : root_(std::filesystem::temp_directory_path() / ("search-engine-" + name + "-" + std::to_string(getpid()))) {
+        std::filesystem::remove_all(this->root_);
+        std::filesystem::create_directories(this->root_);
+    }
+    TestCorpus(const TestCorpus&) = delete;
+    TestCorpus& operator=(const TestCorpus&) = delete;
+    ~TestCorpus() {
+        std::error_code ec;
+        std::filesystem::remove_all(this->root_, ec);
+    }
+
+    inline std::string path() const { return this->root_.string(); }
+    inline std::string FolderPath(const std::string& folder) const { return (this->root_ / folder).string(); }
+
+    /*!
+     * @brief Writes article_count articles, named article_0.json and onwards, into the given folder under the corpus.
+     */
+    void WriteFolder(const std::string& folder, size_t article_count, uint32_t seed) {
+        std::filesystem::create_directories(this->root_ / folder);
+        std::mt19937 generator(seed);
+        for (size_t i = 0; i < article_count; i++) {
+            this->WriteArticle((this->root_ / folder / ("article_" + std::to_string(i) + ".json")).string(), generator);
+        }
+    }
+
+    /*!
+     * @brief Writes a new article over the given file under the corpus, and moves its modification time an hour ahead, so that it is never mistaken for an unchanged source even if it is written within the same second as the old one.
+     */
+    void RewriteArticle(const std::string& relative_path, uint32_t seed) {
+        std::mt19937 generator(seed);
+        this->WriteArticle((this->root_ / relative_path).string(), generator);
+        std::filesystem::last_write_time(this->root_ / relative_path, std::filesystem::file_time_type::clock::now() + std::chrono::hours(1));
+    }
+
+    inline void Remove(const std::string& relative_path) { std::filesystem::remove_all(this->root_ / relative_path); }
+
+    /*!
+     * @brief Writes an article with the given title and text, which are written into the JSON as they are, to the given file under the corpus.
+     */
+    void WriteArticle(const std::string& relative_path, const std::string& title, const std::string& text) {
+        std::filesystem::create_directories((this->root_ / relative_path).parent_path());
+        std::ofstream file(this->root_ / relative_path, std::ios::trunc);
+        file << "{\"thread\": {\"title\": \"" << title << "\", \"site\": \"reuters.com\", \"country\": \"DE\"}, \"author\": \"jane doe\", \"language\": \"english\", ";
+        file << "\"entities\": {\"persons\": [], \"locations\": [], \"organizations\": []}, \"text\": \"" << text << "\"}";
+    }
+
+   private:
+    static constexpr size_t kVocabularySize = 20000;
+    static constexpr size_t kMaxWordCount = 240;
+
+    // Turns a rank of the vocabulary into a word of at least three letters, such that every rank has a word of its own.
+    static std::string Word(size_t rank) {
+        static constexpr const char* kSyllables[] = {"ka", "lo", "mi", "ne", "tu", "ra", "si", "po", "be", "du", "fa", "go", "hi", "ju", "ve", "zo"};
+        std::string word = "x";
+        do {
+            word += kSyllables[rank % 16];
+            rank /= 16;
+        } while (rank > 0);
+        return word;
+    }
+
+    static std::string RandomWord(std::mt19937& generator) {
+        // e^(u * ln(kVocabularySize)) is spread evenly over the orders of magnitude of the ranks, which gives the low ranks most of the draws.
+        const double u = std::uniform_real_distribution<double>(0, 1)(generator);
+        return Word(std::min<size_t>((size_t)std::exp(u * std::log((double)kVocabularySize)) - 1, kVocabularySize - 1));
+    }
+
+    static std::string RandomWords(std::mt19937& generator, size_t word_count) {
+        std::string words;
+        for (size_t i = 0; i < word_count; i++) {
+            words += (i == 0 ? "" : " ") + RandomWord(generator);
+        }
+        return words;
+    }
+
+    void WriteArticle(const std::string& path, std::mt19937& generator) {
+        static constexpr const char* kSites[] = {"reuters.com", "cnbc.com", "wsj.com"};
+        static constexpr const char* kCountries[] = {"US", "GB", "DE"};
+        static constexpr const char* kLanguages[] = {"english", "german"};
+        static constexpr const char* kPeople[] = {"eaton vance", "jane doe", "john smith", "ada lovelace"};
+        const size_t text_word_count = std::uniform_int_distribution<size_t>(20, kMaxWordCount)(generator);
+        std::ofstream file(path, std::ios::trunc);
+        file << "{\"thread\": {\"title\": \"" << RandomWords(generator, std::uniform_int_distribution<size_t>(3, 10)(generator)) << "\", \"site\": \"" << kSites[generator() % 3] << "\", \"country\": \"" << kCountries[generator() % 3] << "\"}, ";
+        file << "\"author\": \"" << Word(generator() % 50) << "\", \"language\": \"" << kLanguages[generator() % 2] << "\", ";
+        file << "\"entities\": {\"persons\": [{\"name\": \"" << kPeople[generator() % 4] << "\"}], \"locations\": [], \"organizations\": []}, ";
+        file << "\"text\": \"" << RandomWords(generator, text_word_count) << "\"}";
+    }
+
+    std::filesystem::path root_;
+};
+
+/*!
+ * @brief Builds query_count queries out of the terms of the given database, spread evenly over its term IDs, which cover alternatives, required and excluded terms, phrases and metadata.
+ */
+template <typename Database>
+std::vector<Query> SampleQueries(const Database& database, size_t query_count) {
+    std::vector<std::string> terms;
+    const size_t term_step = std::max<size_t>(database.term_dictionary.size() / query_count, 1);
+    for (size_t term_id = 0; term_id < database.term_dictionary.size(); term_id += term_step) {
+        const std::string term(database.term_dictionary.Term(term_id));
+        if (term.size() > 2 && term.find_first_of(" ,|\"\\+-") == std::string::npos) {
+            terms.push_back(term);
+        }
+    }
+    std::vector<Query> queries;
+    for (size_t i = 0; i + 1 < terms.size(); i++) {
+        const std::string& term = terms[i];
+        const std::string& next_term = terms[i + 1];
+        switch (i % 4) {
+            case 0:
+                queries.push_back(QueryParser::Parse("values: " + term + " " + next_term + " | title: " + term));
+                break;
+            case 1:
+                queries.push_back(QueryParser::Parse("values: +" + term + " " + next_term + " | sites: reuters.com"));
+                break;
+            case 2:
+                queries.push_back(QueryParser::Parse("values: " + term + " -" + next_term + " | people: \"eaton vance\""));
+                break;
+            default:
+                queries.push_back(QueryParser::Parse("values: \"" + term + " " + next_term + "\"~3 | title: " + next_term));
+                break;
+        }
+    }
+    return queries;
+}
+
+/*!
+ * @brief The answers of the given search engine to every one of the given queries, in order.
+ */
+template <typename SearchEngine>
+std::vector<std::vector<std::string>> Answer(SearchEngine& search_engine, const std::vector<Query>& queries, std::optional<size_t> result_count = std::nullopt) {
+    std::vector<std::vector<std::string>> answers;
+    for (auto&& query : queries) {
+        answers.push_back(search_engine.HandleQuery(query, result_count));
+    }
+    return answers;
+}
+
+/*!
+ * @brief Checks that both builders build identical databases, and that the databases answer the same queries identically in both ranking modes, in full and limited to their 10 best results.
+ * @details Each ranking mode gets databases of its own, since a SearchEngine takes ownership of its database. A builder returns nullptr if it failed.
+ */
+template <typename SearchEngine, typename Engine>
+void ExpectSameDatabases(const std::function<std::unique_ptr<Engine>()>& build, const std::function<std::unique_ptr<Engine>()>& build_reference, size_t query_count) {
+    for (auto ranking_mode : {SearchEngine::RankingMode::kCascade, SearchEngine::RankingMode::kBm25}) {
+        std::unique_ptr<Engine> engine_ptr = build();
+        std::unique_ptr<Engine> reference_engine_ptr = build_reference();
+        ASSERT_NE(engine_ptr, nullptr);
+        ASSERT_NE(reference_engine_ptr, nullptr);
+        const auto* const reference_database_ptr = reference_engine_ptr->GetRuntimeDatabase();
+        ASSERT_TRUE(source_util::HasSameContents(*engine_ptr->GetRuntimeDatabase(), *reference_database_ptr));
+        const std::vector<Query> queries = SampleQueries(*reference_database_ptr, query_count);
+        ASSERT_FALSE(queries.empty());
+        SearchEngine search_engine(std::move(engine_ptr), ranking_mode);
+        SearchEngine reference_search_engine(std::move(reference_engine_ptr), ranking_mode);
+        EXPECT_EQ(Answer(search_engine, queries), Answer(reference_search_engine, queries));
+        EXPECT_EQ(Answer(search_engine, queries, 10), Answer(reference_search_engine, queries, 10));
+    }
+}
+
+}  // namespace test_util
+}  // namespace search_engine
+
+#endif  // SEARCH_ENGINE_PROJECT_TESTS_TESTUTIL_H_
\ No newline at end of file
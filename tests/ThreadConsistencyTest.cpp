@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <memory>
+
+#include "../KaggleFinanceSourceEngine.h"
+#include "../SearchEngine.h"
+#include "TestUtil.h"
+
+namespace {
+
+// The amount of queries that both databases of a test are compared on, spread evenly over the term IDs.
+constexpr size_t kQueryCount = 1000;
+
+template <typename ContainerPolicy>
+class ThreadConsistencyTest : public ::testing::Test {
+   protected:
+    using Engine = search_engine::KaggleFinanceEngine<ContainerPolicy>;
+    using SearchEngine = search_engine::SearchEngine<uint32_t, uint32_t, std::string, ContainerPolicy>;
+
+    ThreadConsistencyTest() : corpus_("threads") {
+        for (uint32_t i = 0; i < 4; i++) {
+            this->corpus_.WriteFolder("folder_" + std::to_string(i), 150, i);
+        }
+    }
+
+    std::unique_ptr<Engine> Parse(size_t parser_thread_count, size_t filler_thread_count, bool record_positions) {
+        std::unique_ptr<Engine> engine_ptr = std::make_unique<Engine>(parser_thread_count, filler_thread_count, record_positions);
+        engine_ptr->ParseSources(this->corpus_.path());
+        return engine_ptr;
+    }
+
+    search_engine::test_util::TestCorpus corpus_;
+};
+
+using ContainerPolicies = ::testing::Types<search_engine::source_util::StdContainerPolicy, search_engine::source_util::FlatContainerPolicy, search_engine::source_util::CompactContainerPolicy>;
+TYPED_TEST_SUITE(ThreadConsistencyTest, ContainerPolicies);
+
+TYPED_TEST(ThreadConsistencyTest, AnyThreadCountsBuildTheSameDatabase) {
+    const std::pair<size_t, size_t> thread_counts[] = {{2, 1}, {4, 3}, {3, 5}};
+    for (bool record_positions : {false, true}) {
+        for (auto&& thread_count : thread_counts) {
+            const size_t parser_thread_count = thread_count.first;
+            const size_t filler_thread_count = thread_count.second;
+            SCOPED_TRACE(std::to_string(parser_thread_count) + " parser thread(s), " + std::to_string(filler_thread_count) + " filler thread(s), positions " + (record_positions == true ? "on" : "off"));
+            search_engine::test_util::ExpectSameDatabases<typename TestFixture::SearchEngine, typename TestFixture::Engine>([&]() { return this->Parse(parser_thread_count, filler_thread_count, record_positions); }, [&]() { return this->Parse(1, 1, record_positions); }, kQueryCount);
+        }
+    }
+}
+
+TYPED_TEST(ThreadConsistencyTest, LoadedIndexMatchesTheParsedDatabase) {
+    const std::string index_path = this->corpus_.path() + "/database.idx";
+    for (bool record_positions : {false, true}) {
+        SCOPED_TRACE(std::string("positions ") + (record_positions == true ? "on" : "off"));
+        ASSERT_TRUE(this->Parse(4, 3, record_positions)->SaveIndex(index_path));
+        auto load = [&]() {
+            std::unique_ptr<typename TestFixture::Engine> engine_ptr = std::make_unique<typename TestFixture::Engine>(1, 1);
+            if (engine_ptr->LoadIndex(index_path) == false) {
+                engine_ptr.reset();
+            }
+            return engine_ptr;
+        };
+        search_engine::test_util::ExpectSameDatabases<typename TestFixture::SearchEngine, typename TestFixture::Engine>(load, [&]() { return this->Parse(1, 1, record_positions); }, kQueryCount);
+    }
+}
+
+}  // namespace
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../Tokenizer.h"
+
+namespace {
+
+using search_engine::source_util::Tokenizer;
+
+// Tokens of every length around the eight bytes TermHasher::AddWords hashes at once, some of which take the slow path for their apostrophes or upper-case letters.
+TEST(TokenizerTest, TokensHashLikeHashTerm) {
+    const std::vector<std::string> words = {"a", "seven77", "eight888", "ninenine9", "sixteen-bytes-xx", "seventeen-bytes-x", "don't", "Upper-Case-Letters", "it's-a-long-token"};
+    std::string text;
+    for (auto&& word : words) {
+        text += word + " ";
+    }
+    Tokenizer tokenizer(text.data(), text.size());
+    Tokenizer::Token token;
+    for (auto&& word : words) {
+        SCOPED_TRACE(word);
+        ASSERT_TRUE(tokenizer.Next(token));
+        std::string cleaned_word;
+        EXPECT_EQ(token.hash, Tokenizer::HashTerm(word.data(), word.size(), &cleaned_word));
+        EXPECT_EQ(std::string(token.data, token.size), cleaned_word);
+    }
+    EXPECT_FALSE(tokenizer.Next(token));
+}
+
+}  // namespace
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <optional>
+
+#include "../KaggleFinanceSourceEngine.h"
+#include "../SearchEngine.h"
+#include "TestUtil.h"
+
+namespace {
+
+using Engine = search_engine::KaggleFinanceEngine<search_engine::source_util::CompactContainerPolicy>;
+using SearchEngine = search_engine::SearchEngine<uint32_t, uint32_t, std::string, search_engine::source_util::CompactContainerPolicy>;
+
+// The amount of queries that the updated database is compared on, spread evenly over the term IDs.
+constexpr size_t kQueryCount = 1000;
+// The sources that are rewritten and removed before the update, out of the first two folders.
+constexpr size_t kChangedCount = 30;
+constexpr size_t kRemovedCount = 40;
+
+/*!
+ * @brief Indexes two folders, and then adds a third one, rewrites some of the indexed sources and removes others, which the update has to catch up with.
+ */
+class UpdateConsistencyTest : public ::testing::Test {
+   protected:
+    UpdateConsistencyTest() : corpus_("update"), index_path_(corpus_.path() + "/database.idx") {
+        this->corpus_.WriteFolder("folder_0", 150, 0);
+        this->corpus_.WriteFolder("folder_1", 150, 1);
+        Engine engine(4, 3, true);
+        engine.ParseSources(this->corpus_.path());
+        this->index_written_ = engine.SaveIndex(this->index_path_);
+
+        // The third folder has terms of its own, which the update adds to the term dictionary that the index file holds.
+        this->corpus_.WriteFolder("folder_2", 150, 2);
+        for (size_t i = 0; i < kChangedCount; i++) {
+            this->corpus_.RewriteArticle("folder_0/article_" + std::to_string(i) + ".json", 100 + i);
+        }
+        for (size_t i = 0; i < kRemovedCount; i++) {
+            this->corpus_.Remove("folder_1/article_" + std::to_string(i) + ".json");
+        }
+    }
+
+    // Loads the index file, and brings it up to date with the given thread counts from the corpus at the given spelling of its path, or returns nullptr if the index file cannot be loaded.
+    std::unique_ptr<Engine> Update(size_t parser_thread_count, size_t filler_thread_count, std::optional<std::string> corpus_path = std::nullopt) {
+        std::unique_ptr<Engine> engine_ptr = std::make_unique<Engine>(parser_thread_count, filler_thread_count, true);
+        if (engine_ptr->LoadIndex(this->index_path_) == false) {
+            return nullptr;
+        }
+        engine_ptr->ParseSources(corpus_path.value_or(this->corpus_.path()));
+        engine_ptr->WaitForMerges();
+        return engine_ptr;
+    }
+
+    search_engine::test_util::TestCorpus corpus_;
+    std::string index_path_;
+    bool index_written_ = false;
+};
+
+TEST_F(UpdateConsistencyTest, AnyThreadCountsUpdateToTheSameDatabase) {
+    ASSERT_TRUE(this->index_written_);
+    std::unique_ptr<Engine> engine_ptr = this->Update(4, 3);
+    ASSERT_NE(engine_ptr, nullptr);
+    const auto& change_stats = engine_ptr->GetSourceChangeStats();
+    EXPECT_EQ(change_stats.new_count, 150);
+    EXPECT_EQ(change_stats.changed_count, kChangedCount);
+    EXPECT_EQ(change_stats.removed_count, kRemovedCount);
+    EXPECT_EQ(engine_ptr->GetRuntimeDatabase()->segments.size(), 2);
+    EXPECT_EQ(engine_ptr->GetRuntimeDatabase()->document_table.deleted_count(), kChangedCount + kRemovedCount);
+    search_engine::test_util::ExpectSameDatabases<SearchEngine, Engine>([&]() { return this->Update(4, 3); }, [&]() { return this->Update(1, 1); }, kQueryCount);
+}
+
+// Every parser thread looks terms up in the mapped term dictionary while the others add the new terms of the third folder to it, which is only safe if the lookups never read what the additions grow. Run under ThreadSanitizer to catch a race that does not change the database.
+TEST_F(UpdateConsistencyTest, ParserThreadsInternNewTermsNextToTheMappedOnes) {
+    ASSERT_TRUE(this->index_written_);
+    for (size_t parser_thread_count : {2, 4, 8}) {
+        SCOPED_TRACE(std::to_string(parser_thread_count) + " parser thread(s)");
+        search_engine::test_util::ExpectSameDatabases<SearchEngine, Engine>([&]() { return this->Update(parser_thread_count, 2); }, [&]() { return this->Update(1, 1); }, kQueryCount / 10);
+    }
+}
+
+// The same folder, spelled relative to the working directory and with a detour through one of its subfolders, must not be taken for another folder whose sources are all new.
+TEST_F(UpdateConsistencyTest, UpdateThroughAnotherSpellingOfThePathFindsTheIndexedSources) {
+    ASSERT_TRUE(this->index_written_);
+    const std::string relative_path = std::filesystem::relative(this->corpus_.path()).string() + "/folder_0/../";
+    std::unique_ptr<Engine> engine_ptr = this->Update(4, 3, relative_path);
+    ASSERT_NE(engine_ptr, nullptr);
+    const auto& change_stats = engine_ptr->GetSourceChangeStats();
+    EXPECT_EQ(change_stats.new_count, 150);
+    EXPECT_EQ(change_stats.changed_count, kChangedCount);
+    EXPECT_EQ(change_stats.removed_count, kRemovedCount);
+    const auto& document_table = engine_ptr->GetRuntimeDatabase()->document_table;
+    EXPECT_EQ(document_table.size() - document_table.deleted_count(), 3 * 150 - kRemovedCount);
+    search_engine::test_util::ExpectSameDatabases<SearchEngine, Engine>([&]() { return this->Update(4, 3, relative_path); }, [&]() { return this->Update(4, 3); }, kQueryCount / 10);
+}
+
+TEST_F(UpdateConsistencyTest, UpdatedIndexFileLoadsTheUpdatedDatabase) {
+    ASSERT_TRUE(this->index_written_);
+    const std::string updated_index_path = this->corpus_.path() + "/updated.idx";
+    ASSERT_TRUE(this->Update(4, 3)->SaveIndex(updated_index_path));
+    auto load = [&]() {
+        std::unique_ptr<Engine> engine_ptr = std::make_unique<Engine>(1, 1);
+        if (engine_ptr->LoadIndex(updated_index_path) == false) {
+            engine_ptr.reset();
+        }
+        return engine_ptr;
+    };
+    search_engine::test_util::ExpectSameDatabases<SearchEngine, Engine>(load, [&]() { return this->Update(1, 1); }, kQueryCount);
+}
+
+// A full rebuild numbers the documents in another order, which only changes the order of equally ranked results, so the results are compared as sets. The deleted sources still count toward the average field lengths of the updated database, which can reorder its results too.
+TEST_F(UpdateConsistencyTest, UpdateFindsTheSameSourcesAsAFullRebuild) {
+    ASSERT_TRUE(this->index_written_);
+    std::unique_ptr<Engine> engine_ptr = this->Update(4, 3);
+    ASSERT_NE(engine_ptr, nullptr);
+    std::unique_ptr<Engine> rebuilt_engine_ptr = std::make_unique<Engine>(4, 3, true);
+    rebuilt_engine_ptr->ParseSources(this->corpus_.path());
+    const std::vector<search_engine::Query> queries = search_engine::test_util::SampleQueries(*rebuilt_engine_ptr->GetRuntimeDatabase(), kQueryCount);
+    SearchEngine search_engine(std::move(engine_ptr), SearchEngine::RankingMode::kBm25);
+    SearchEngine rebuilt_search_engine(std::move(rebuilt_engine_ptr), SearchEngine::RankingMode::kBm25);
+    std::vector<std::vector<std::string>> answers = search_engine::test_util::Answer(search_engine, queries);
+    std::vector<std::vector<std::string>> rebuilt_answers = search_engine::test_util::Answer(rebuilt_search_engine, queries);
+    for (size_t i = 0; i < queries.size(); i++) {
+        std::sort(answers[i].begin(), answers[i].end());
+        std::sort(rebuilt_answers[i].begin(), rebuilt_answers[i].end());
+    }
+    EXPECT_EQ(answers, rebuilt_answers);
+}
+
+}  // namespace
\ No newline at end of file